@@ -0,0 +1,203 @@
+#pragma once
+#include <SFML/Audio.hpp>
+#include <SFML/Graphics.hpp>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace momo {
+
+// Approximate resident size of an asset, used to charge it against the budget.
+inline size_t assetBytes(const sf::Texture &tex) {
+  sf::Vector2u s = tex.getSize();
+  return size_t(s.x) * s.y * 4;
+}
+
+inline size_t assetBytes(const sf::SoundBuffer &buff) {
+  return size_t(buff.getSampleCount()) * sizeof(sf::Int16);
+}
+
+// AssetCache --------------------------------------------------
+// Name keyed cache with a byte budget. Assets are loaded on first acquire and
+// stay resident while referenced; once their refcount drops to zero they are
+// kept around in least-recently-used order and evicted when the cache grows
+// over budget. Assets live behind a unique_ptr so their addresses stay valid
+// for as long as they are pinned (sf::Sprite/sf::Sound keep raw pointers).
+template <typename T> struct AssetCache {
+  typedef std::function<bool(T &, const std::string &)> Loader;
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t residentBytes = 0;
+    size_t peakBytes = 0;
+
+    float hitRate() const {
+      size_t total = hits + misses;
+      return total == 0 ? 0.f : float(hits) / float(total);
+    }
+  };
+
+  // Pins an asset for its lifetime.
+  struct Ref {
+    Ref() = default;
+    Ref(AssetCache *cache, const std::string &name, T *asset)
+        : cache(cache), name(name), asset(asset) {}
+    Ref(const Ref &other) : Ref(other.cache, other.name, other.asset) {
+      if (cache && asset)
+        cache->pin(name);
+    }
+    Ref(Ref &&other) noexcept
+        : cache(other.cache), name(std::move(other.name)), asset(other.asset) {
+      other.cache = nullptr;
+      other.asset = nullptr;
+    }
+    Ref &operator=(Ref other) noexcept {
+      std::swap(cache, other.cache);
+      std::swap(name, other.name);
+      std::swap(asset, other.asset);
+      return *this;
+    }
+    ~Ref() {
+      if (cache && asset)
+        cache->release(name);
+    }
+
+    T *get() const { return asset; }
+    T &operator*() const { return *asset; }
+    T *operator->() const { return asset; }
+    explicit operator bool() const { return asset != nullptr; }
+
+  private:
+    AssetCache *cache = nullptr;
+    std::string name;
+    T *asset = nullptr;
+  };
+
+  AssetCache(Loader loader, size_t budget = 0)
+      : loader(std::move(loader)), budget(budget) {}
+  AssetCache(const AssetCache &) = delete;
+  AssetCache &operator=(const AssetCache &) = delete;
+
+  // Returns the asset pinned, loading it on a miss. nullptr if loading fails.
+  T *acquire(const std::string &name) {
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+      ++stats.hits;
+      touch(it->second);
+      ++it->second.refs;
+      return it->second.asset.get();
+    }
+
+    ++stats.misses;
+    auto asset = std::make_unique<T>();
+    if (!loader || !loader(*asset, name))
+      return nullptr;
+
+    Entry &e = entries[name];
+    e.bytes = assetBytes(*asset);
+    e.asset = std::move(asset);
+    e.refs = 1;
+    lru.push_front(name);
+    e.lruIt = lru.begin();
+
+    stats.residentBytes += e.bytes;
+    if (stats.residentBytes > stats.peakBytes)
+      stats.peakBytes = stats.residentBytes;
+    trim();
+    return e.asset.get();
+  }
+
+  Ref acquireRef(const std::string &name) {
+    T *asset = acquire(name);
+    return asset ? Ref(this, name, asset) : Ref();
+  }
+
+  void pin(const std::string &name) {
+    auto it = entries.find(name);
+    if (it != entries.end())
+      ++it->second.refs;
+  }
+
+  void release(const std::string &name) {
+    auto it = entries.find(name);
+    if (it == entries.end() || it->second.refs == 0)
+      return;
+    --it->second.refs;
+    trim();
+  }
+
+  // Looks an asset up without loading or pinning it.
+  T *peek(const std::string &name) const {
+    auto it = entries.find(name);
+    return it == entries.end() ? nullptr : it->second.asset.get();
+  }
+
+  bool contains(const std::string &name) const {
+    return entries.find(name) != entries.end();
+  }
+
+  // 0 means unlimited.
+  void setBudget(size_t bytes) {
+    budget = bytes;
+    trim();
+  }
+  size_t getBudget() const { return budget; }
+
+  // Evicts unpinned assets from the cold end until back under budget.
+  void trim() {
+    if (budget == 0)
+      return;
+    auto it = lru.end();
+    while (stats.residentBytes > budget && it != lru.begin()) {
+      --it;
+      auto e = entries.find(*it);
+      if (e->second.refs > 0)
+        continue;
+      stats.residentBytes -= e->second.bytes;
+      ++stats.evictions;
+      it = lru.erase(it);
+      entries.erase(e);
+    }
+  }
+
+  // Drops every unpinned asset regardless of budget.
+  void clear() {
+    for (auto it = lru.begin(); it != lru.end();) {
+      auto e = entries.find(*it);
+      if (e->second.refs > 0) {
+        ++it;
+        continue;
+      }
+      stats.residentBytes -= e->second.bytes;
+      ++stats.evictions;
+      it = lru.erase(it);
+      entries.erase(e);
+    }
+  }
+
+  size_t size() const { return entries.size(); }
+  const Stats &getStats() const { return stats; }
+
+private:
+  struct Entry {
+    std::unique_ptr<T> asset;
+    size_t bytes = 0;
+    int refs = 0;
+    std::list<std::string>::iterator lruIt;
+  };
+
+  void touch(Entry &e) { lru.splice(lru.begin(), lru, e.lruIt); }
+
+  Loader loader;
+  size_t budget;
+  Stats stats;
+  std::unordered_map<std::string, Entry> entries;
+  std::list<std::string> lru; // most recently used first
+};
+
+}; // namespace momo
@@ -1,4 +1,5 @@
 #pragma once
+#include "AssetCache.hpp"
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include <string>
@@ -46,6 +47,30 @@ struct AssetManager {
                      const std::string &prefix = "res/fonts/",
                      const std::string &suffix = ".ttf");
   sf::Font &getFont(const std::string &name);
+
+  // Budgeted caches; unlike the maps above these evict least recently used
+  // assets once nothing references them. Names resolve like loadTexture and
+  // loadSBuff with the default prefix/suffix.
+  AssetCache<sf::Texture> textureCache{
+      [](sf::Texture &tex, const std::string &name) {
+        return tex.loadFromFile(TEX_PREFIX + name + TEX_SUFFIX);
+      }};
+  AssetCache<sf::SoundBuffer> sBuffCache{
+      [](sf::SoundBuffer &buff, const std::string &name) {
+        return buff.loadFromFile(SFX_PREFIX + name + ".wav");
+      }};
+
+  AssetCache<sf::Texture>::Ref acquireTexture(const std::string &name) {
+    return textureCache.acquireRef(name);
+  }
+  AssetCache<sf::SoundBuffer>::Ref acquireSBuff(const std::string &name) {
+    return sBuffCache.acquireRef(name);
+  }
+  // 0 disables eviction.
+  void setMemoryBudget(size_t textureBytes, size_t soundBytes) {
+    textureCache.setBudget(textureBytes);
+    sBuffCache.setBudget(soundBytes);
+  }
 };
 
 }; // namespace momo
@@ -1,17 +1,34 @@
 #ifndef _SFML_HELPER_H_
 #define _SFML_HELPER_H_
 
+#include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include <SFML/Network.hpp>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <latch>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdcpp.hpp>
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#endif
 
 namespace fs = std::filesystem;
 
@@ -33,37 +50,88 @@ typedef std::string str;
 // macros ==================================================
 #define DEFAULT_FONT_NAME "res/font/IosevkaNerdFontMono-Regular.ttf"
 #define DEFAULT_CHAR_SIZE 32
+#define DEFAULT_REFRESH_RATE 60
 
 // data.dat ==================================================
-enum Data_type { None = -1, Font, Texture, Sound, Shader };
+enum Data_type { None = -1, Font, Texture, Sound, Shader, Alias };
 
 // #define LOG_DATA_CHUNK_FREE
 
+// one block of memory backing the payloads of a read, freed all at once
+struct Data_arena {
+  char *block{nullptr};
+  size_t size{0};
+  size_t used{0};
+
+  Data_arena() = default;
+  explicit Data_arena(size_t _size);
+  Data_arena(const Data_arena &) = delete;
+  Data_arena &operator=(const Data_arena &) = delete;
+  Data_arena(Data_arena &&other) noexcept;
+  Data_arena &operator=(Data_arena &&other) noexcept;
+  ~Data_arena();
+
+  char *allocate(size_t n);
+  void free();
+};
+
+// move-only; `data` points into `storage` or into the arena of a `Data_pack`
 struct Data_chunk {
-  Data_type type;
-  size_t data_size;
-  size_t name_size;
+  Data_type type{Data_type::None};
+  size_t data_size{0};
+  size_t name_size{0};
+  uint32_t crc{0};
   std::string name;
-  char *data;
+  char *data{nullptr};
+  size_t offset{0}; // of `data` in the data file
+  bool verified{false};
+  Data_arena storage;
 
   void free();
   void allocate(size_t size);
   size_t total_size() const;
+  // checks `data` against the stored crc (once; the result is cached)
+  bool verify();
 
-  static size_t data_allocated;
+  static size_t data_allocated; // live arena blocks
+};
+
+// every chunk of a data file, with all payloads in one arena
+struct Data_pack {
+  Data_arena arena;
+  std::vector<Data_chunk> chunks;
 };
 
 /* data.dat format
+   [magic "WPMD"]
+   [version]
    [data_type]
    [data_size]
    [name_size]
+   [crc32c of data]
    [name]
    [data]
    ...
- */
 
-std::vector<std::string> list_of_names_in_data();
-std::vector<Data_chunk> list_of_chunks_in_data();
+   An `Alias` chunk's data is the name of an earlier chunk with the same
+   payload (written by `write_pack`); `list_of_chunks_in_data` resolves it
+   to a view of that chunk's payload.
+ */
+#define DATA_MAGIC 0x444D5057 // "WPMD"
+#define DATA_VERSION 2
+
+bool open_data(std::ifstream &ifs, size_t &total_bytes,
+               const std::string &filename = "data.dat");
+bool read_chunk_header(std::ifstream &ifs, Data_chunk &chunk,
+                       size_t total_bytes);
+void write_data_header(std::ofstream &ofs);
+void write_chunk(std::ofstream &ofs, Data_type type, const std::string &name,
+                 const char *data, size_t data_size, uint32_t crc);
+uint32_t crc32c(const char *data, size_t size, uint32_t crc = 0);
+
+std::vector<std::string>
+list_of_names_in_data(const std::string &filename = "data.dat");
+Data_pack list_of_chunks_in_data(const std::string &filename = "data.dat");
 bool remove_chunk_from_data(const std::string &filename);
 bool remove_all_chunks_from_data();
 bool write_chunk_to_data(const Data_type &type, const std::string &filename);
@@ -78,20 +146,286 @@ bool read_texture_from_data(Data_chunk &chunk, const std::string &filename);
 bool read_sound_from_data(Data_chunk &chunk, const std::string &filename);
 bool read_shader_from_data(Data_chunk &chunk, const std::string &filename);
 bool chunk_exists_in_data(const std::string &filename);
+// reads only the header of a chunk (following aliases), `chunk.data` is null
+bool find_chunk_in_data(Data_chunk &chunk, const std::string &name,
+                        Data_type type = Data_type::None,
+                        const std::string &filename = "data.dat");
+// checks every chunk's crc across all cores
+bool verify_data(const std::string &filename = "data.dat");
+
+// hash --------------------------------------------------
+constexpr uint64_t hash_fnv1a(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= uint64_t(uint8_t(data[i]));
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// asset ids --------------------------------------------------
+// a dense index handed out by `Resource_manager::id`
+struct Asset_id {
+  uint32_t index;
+};
+
+// hash of an asset name at compile time, e.g. ASSET_HASH("res/gfx/a.png")
+#define ASSET_HASH(name)                                                       \
+  (std::integral_constant<uint64_t,                                            \
+                          sh::hash_fnv1a(name, sizeof(name) - 1)>::value)
+
+// thread_pool --------------------------------------------------
+struct Thread_pool {
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable job_cv, done_cv;
+  size_t busy{0};
+  bool stopping{false};
+
+  // count == 0 uses one worker per hardware thread
+  Thread_pool(size_t count = 0);
+  ~Thread_pool();
+
+  void push(std::function<void()> job);
+  void wait();
+  void parallel_for(size_t count, const std::function<void(size_t)> &func);
+};
+
+// profiler --------------------------------------------------
+// Scoped timing markers, recorded into a ring buffer per thread. Compiled out
+// unless SH_PROFILER is defined:
+//   { PROFILE_SCOPE("update"); ... }
+#define SH_CONCAT_(a, b) a##b
+#define SH_CONCAT(a, b) SH_CONCAT_(a, b)
+#ifdef SH_PROFILER
+#define PROFILE_SCOPE(name)                                                    \
+  sh::Profile_scope SH_CONCAT(_profile_scope_, __LINE__) { (name) }
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+struct Profile_event {
+  const char *name{nullptr};
+  uint64_t start_ns{0}, end_ns{0};
+};
+
+struct Profiler {
+  static constexpr size_t RING_SIZE = 4096; // events kept per thread
+  static constexpr size_t FRAME_HISTORY = 240;
+
+  struct Thread_ring {
+    Profile_event events[RING_SIZE];
+    std::atomic<size_t> head{0}; // events ever written
+    uint32_t tid{0};
+  };
+
+  static std::mutex rings_mutex;
+  static std::vector<std::unique_ptr<Thread_ring>> rings;
+  static float frame_ms[FRAME_HISTORY];
+  static size_t frame_count;
+
+  static uint64_t now_ns();
+  static Thread_ring &ring(); // this thread's, registered on first use
+  static void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+  static void frame(float delta);
+  static bool export_chrome_trace(const std::string &filename);
+};
+
+struct Profile_scope {
+  const char *name;
+  uint64_t start_ns;
+
+  Profile_scope(const char *_name);
+  ~Profile_scope();
+};
+
+// allocation tracking --------------------------------------------------
+// Counts every heap allocation when SH_TRACK_ALLOCATIONS replaces the global
+// operator new/delete (the counters stay at 0 otherwise). The thread_
+// counters only see the calling thread, so loader, audio and logger threads
+// don't show up in the main thread's numbers.
+struct Alloc_stats {
+  static std::atomic<size_t> allocations;
+  static std::atomic<size_t> frees;
+  static std::atomic<size_t> bytes;
+  static thread_local size_t thread_allocations;
+  static thread_local size_t thread_bytes;
+};
+
+// allocations made by this thread since construction
+struct Alloc_scope {
+  size_t start_allocations, start_bytes;
+
+  Alloc_scope();
+  size_t allocations() const;
+  size_t bytes() const;
+};
+
+// pack --------------------------------------------------
+struct Pack_entry {
+  Data_type type{Data_type::None};
+  std::string name;
+  std::vector<char> data;
+  uint64_t hash{0};
+  uint32_t crc{0};
+  int alias_of{-1}; // index of the entry with the same payload
+  bool read{false};  // set once the whole file was read (it may be empty)
+};
+
+Data_type data_type_from_extension(const std::string &filename);
+bool pack_entries_from_dir(std::vector<Pack_entry> &entries,
+                           const std::string &dir);
+bool pack_entries_from_manifest(std::vector<Pack_entry> &entries,
+                                const std::string &manifest);
+bool write_pack(std::vector<Pack_entry> &entries,
+                const std::string &filename = "data.dat");
+
+// data_stream --------------------------------------------------
+// reads a chunk straight from the data file without loading it into memory
+struct Data_stream : sf::InputStream {
+  std::ifstream ifs;
+  Data_chunk chunk;
+  sf::Int64 pos{0};
+
+  bool open(const std::string &name, Data_type type = Data_type::None,
+            const std::string &filename = "data.dat");
+  // checks the chunk's crc by reading it through a small buffer
+  bool verify();
+
+  sf::Int64 read(void *data, sf::Int64 size) override;
+  sf::Int64 seek(sf::Int64 position) override;
+  sf::Int64 tell() override;
+  sf::Int64 getSize() override;
+};
+
+// asset handles --------------------------------------------------
+// resolve on first use: a placeholder is returned until the asset is loaded
+struct Resource_manager;
+struct Texture_handle {
+  Resource_manager *res_man{nullptr};
+  std::string name;
+  sf::Texture *texture{nullptr}; // set once the real texture is available
+
+  sf::Texture &get();
+  bool ready();
+};
+
+struct Font_handle {
+  Resource_manager *res_man{nullptr};
+  std::string name;
+  sf::Font *font{nullptr}; // set once the real font is available
+
+  sf::Font &get();
+  bool ready();
+};
 
 // resource_manager --------------------------------------------------
 struct Resource_manager {
-  std::vector<Data_chunk> texture_chunks;
+  // sf::Font reads its data lazily, so font payloads are kept alive here
   std::vector<Data_chunk> font_chunks;
+  // loads decode here, only the texture upload happens on the GL thread
+  Thread_pool pool;
+  // decode on `pool` and report per-asset timing; what is already loaded or
+  // pending is skipped
   bool load_all_textures();
   bool load_all_fonts();
+  bool load_all(Data_type type);
 
   sf::Font &load_font(const std::string &filename);
+  // compiles every shader chunk and reports how long each one took
+  bool load_all_shaders();
+  sf::Shader &load_shader(const std::string &filename);
+  sf::SoundBuffer &load_sound(const std::string &filename);
+  // the music streams from the data file for as long as it is open
+  sf::Music &open_music(const std::string &filename);
+
+  struct Music {
+    Data_stream stream;
+    sf::Music music;
+  };
 
   std::unordered_map<std::string, sf::Texture> textures;
   std::unordered_map<std::string, sf::Font> fonts;
+  std::unordered_map<std::string, sf::SoundBuffer> sounds;
+  std::unordered_map<std::string, std::unique_ptr<Music>> musics;
+  // compiled programs keyed by (source hash, stage), shared by identical sources
+  std::map<std::pair<uint64_t, sf::Shader::Type>, std::unique_ptr<sf::Shader>>
+      shader_programs;
+  std::unordered_map<std::string, sf::Shader *> shaders;
+  // loads synchronously if the texture isn't loaded yet
   sf::Texture &get_texture(const std::string &filename);
   sf::Font &get_font(const std::string &filename);
+  sf::Shader &get_shader(const std::string &filename);
+
+  // interning: resolve a name once, then index by id every frame
+  std::unordered_map<uint64_t, Asset_id> ids; // name hash -> id
+  std::vector<std::string> id_names;
+  std::vector<sf::Texture *> texture_table;
+  std::vector<sf::Font *> font_table;
+  // where each chunk's payload is in `data.dat`, aliases resolved to their
+  // target, so loads seek straight to it instead of rescanning the file
+  struct Chunk_location {
+    Data_type type{Data_type::None};
+    size_t offset{0};
+    size_t data_size{0};
+    uint32_t crc{0};
+  };
+  std::unordered_map<std::string, Chunk_location> chunk_index;
+  bool indexed{false};
+  // interns every chunk name in `data.dat` and fills `chunk_index`
+  void index_data();
+  // fills the header of `chunk` from the index, `chunk.data` stays null
+  bool find_chunk(Data_chunk &chunk, const std::string &name,
+                  Data_type type = Data_type::None);
+  // reads and verifies the payload, warns and returns false on failure
+  bool read_chunk(Data_chunk &chunk, const std::string &name,
+                  Data_type type = Data_type::None);
+  Asset_id id(const std::string &filename);
+  // for names hashed with ASSET_HASH, must be interned already
+  Asset_id id(uint64_t name_hash);
+  sf::Texture &get_texture(Asset_id id);
+  sf::Font &get_font(Asset_id id);
+  sf::SoundBuffer &get_sound(const std::string &filename);
+  sf::Music &get_music(const std::string &filename);
+
+  // lazy loading; the chunk is located (through the index) and allocated on
+  // the requesting thread, the worker only reads, verifies and decodes it and
+  // never exits on failure
+  struct Async_load {
+    Data_type type{Data_type::None};
+    std::string name;
+    Data_chunk chunk;
+    sf::Image image;
+    sf::Font font;
+    float decode_ms{0.f};
+    bool ok{false};
+    std::atomic<bool> done{false};
+
+    // on a worker; sets `done` (and notifies) when finished
+    void decode();
+  };
+  std::unordered_map<std::string, std::shared_ptr<Async_load>> pending;
+  // names that failed to load, not requested again
+  std::unordered_set<std::string> failed_loads;
+  sf::Texture placeholder_texture;
+
+  Texture_handle texture(const std::string &filename);
+  Font_handle font(const std::string &filename);
+  // starts loading on `pool` unless already loaded, pending or failed
+  void request(Data_type type, const std::string &filename);
+  // finishes completed loads (texture upload), call on the GL thread; returns
+  // false if any of them failed (see `failed_loads`)
+  bool update();
+  std::shared_ptr<Async_load> prepare_load(Data_type type,
+                                           const std::string &filename);
+  // uploads/adopts a decoded load on the GL thread and reports its timing;
+  // a failure is warned about and added to `failed_loads`
+  bool finish_load(Async_load &load);
+  // waits for a pending load of `filename`, if any, and finishes it
+  void finish_pending(const std::string &filename);
+  sf::Texture &get_placeholder_texture();
+  sf::Font &get_placeholder_font();
 };
 
 enum Align {
@@ -122,10 +456,51 @@ struct UI {
     void push_widget(const sf::Vector2f &size);
   };
 
+  // layout of a widget from the previous frame, keyed by its id; reused as
+  // long as the label, size, alignment, available position and look match
+  struct Widget {
+    uint64_t label_hash{0};
+    uint64_t style{0}; // colors/state that change what is drawn
+    size_t char_size{0};
+    Align align{TopLeft};
+    sf::Vector2f avail_pos{};
+    sf::Vector2f extra{};
+    sf::Vector2f text_size{};
+    sf::Vector2f pos{};
+    sf::Vector2f size{};
+    sf::Vector2f size_to_push{};
+    bool valid{false};
+  };
+
+  // everything between begin() and end(), identified by its call order in
+  // the frame; panels that weren't begun in the last frame the UI ran are
+  // dropped
+  struct Panel {
+    std::vector<Widget> widgets;
+    bool dirty{true}; // something changed this frame, or the panel is new
+    sf::FloatRect bounds{}, prev_bounds{}; // covered by its widgets
+    size_t first_batch{0}, end_batch{0};   // its geometry in `batches`
+    bool deferred{false};                  // ended with end(false)
+  };
+
   int active_id{0}, current_id{0};
   std::vector<Layout> layouts;
+  std::vector<Panel> panels;
+  size_t current_panel{0};
+  size_t panels_begun{0}; // this frame
+  size_t frame{SIZE_MAX}; // Data::frame_index the panels were begun in
   Data *d_ptr{nullptr};
 
+  // geometry of the panels begun this frame, in panel order; each panel has
+  // one batch for solid geometry (rects, lines, circles; texture nullptr),
+  // drawn first, and one per glyph page it uses
+  struct Batch {
+    const sf::Texture *texture{nullptr};
+    sf::VertexArray vertices{sf::Triangles};
+  };
+  std::vector<Batch> batches;
+  size_t batch_count{0}; // in use, the rest keep their capacity
+
   UI(Data &d);
 
   Layout *top_layout();
@@ -148,7 +523,29 @@ struct UI {
             size_t char_size = DEFAULT_CHAR_SIZE,
             sf::Color col = sf::Color::White);
   void spacing(const sf::Vector2f &size, const Align &align = TopLeft);
-  void end();
+  // submits the panel, or with `submit` false keeps it for draw(), so a
+  // cached copy of it (e.g. a Layer) is only redrawn when it changed;
+  // returns true if the panel looks different than last frame
+  bool end(bool submit = true);
+  // what the last ended panel covers now and covered before, i.e. the part
+  // of a cached copy to redraw when end() returned true
+  sf::FloatRect changed_bounds() const;
+  // submits the panels ended with end(false) this frame; can be called
+  // again, e.g. once per invalidated layer region
+  void draw();
+  void draw_batches(size_t first, size_t end);
+
+  sf::VertexArray &batch_for(const sf::Texture *texture);
+  void push_text(const sf::Vector2f &pos, const std::string &str,
+                 size_t char_size, sf::Color col);
+
+  static void align_widget(const Align &align, const sf::Vector2f &size,
+                           sf::Vector2f &pos, sf::Vector2f &size_to_push);
+  Widget &widget(int id, const std::string &label, size_t char_size,
+                 const Align &align, const sf::Vector2f &avail_pos,
+                 const sf::Vector2f &extra = {});
+  // marks the panel dirty when what a widget draws changes without its layout
+  void set_style(Widget &w, uint64_t style);
 };
 
 // timer --------------------------------------------------
@@ -319,7 +716,92 @@ struct State {
   bool held = false, just_pressed = false, pressed = false, released = false;
 };
 
+// text_size_cache --------------------------------------------------
+// Fixed size, set associative cache of measured text sizes keyed by
+// (string, char size, font). Never allocates; the least recently used way of
+// a full set is overwritten. Entries keep a copy of the string so a hash
+// collision can't return the wrong size; strings longer than MAX_TEXT aren't
+// cached.
+struct Text_size_cache {
+  static constexpr size_t SETS = 64;
+  static constexpr size_t WAYS = 4;
+  static constexpr size_t MAX_TEXT = 64;
+
+  struct Entry {
+    uint64_t hash{0};
+    const sf::Font *font{nullptr};
+    uint32_t char_size{0};
+    uint32_t stamp{0}; // 0 means empty
+    sf::Vector2f size{};
+    uint32_t len{0};
+    char text[MAX_TEXT];
+  };
+
+  Entry entries[SETS][WAYS]{};
+  uint32_t tick{0};
+  size_t hits{0}, misses{0};
+
+  bool find(const std::string &text, const sf::Font *font, uint32_t char_size,
+            sf::Vector2f &size);
+  void insert(const std::string &text, const sf::Font *font,
+              uint32_t char_size, const sf::Vector2f &size);
+  void clear();
+};
+
 // data --------------------------------------------------
+// Direct: everything is drawn straight into the window (scale == 1).
+// Upscaled: drawn into `ren_tex` at width x height, then stretched over the
+// window.
+enum class Render_mode { Direct, Upscaled };
+
+// Cached, screen sized render texture. Only redrawn after it was invalidated;
+// otherwise it is composited as a single textured quad. Invalidating a region
+// redraws just that part: it is erased and drawn again with a view clipped to
+// it, once per region.
+struct Layer {
+  static constexpr size_t MAX_REGIONS = 8;
+
+  sf::RenderTexture tex;
+  bool dirty{true};
+  // in layer pixels, only used while the layer isn't dirty as a whole; past
+  // MAX_REGIONS they are merged into their bounds
+  sf::FloatRect regions[MAX_REGIONS];
+  size_t region_count{0};
+  size_t next_region{0}; // redrawn by the next begin_layer()
+};
+
+// Per frame counters of what reached the gpu through Data.
+struct Render_stats {
+  size_t draw_calls{0};
+  size_t vertices{0};
+  size_t texture_switches{0};
+  size_t shader_switches{0};
+  size_t view_switches{0};
+  size_t rt_passes{0}; // render targets drawn into
+};
+
+// Fixed bucket histogram of latencies in milliseconds.
+struct Latency_histogram {
+  static constexpr size_t BUCKETS = 400;
+  static constexpr float BUCKET_MS = 0.25f; // last bucket collects >= 99.75ms
+
+  uint32_t buckets[BUCKETS]{};
+  size_t count{0};
+  float max_ms{0.f};
+
+  void add(float ms);
+  // p in [0, 1]; upper edge of the bucket the percentile falls in
+  float percentile(float p) const;
+  void reset();
+};
+
+// Vsync: block in display() on the swap.
+// Low_latency: vsync, but sleep until just before the predicted vblank before
+// polling input, so fresh input makes it into the next swap.
+// Uncapped: no vsync (tearing allowed), optionally capped by a software
+// frame limiter.
+enum class Frame_pacing { Vsync, Low_latency, Uncapped };
+
 struct Data {
   sf::RectangleShape rect;
   sf::CircleShape circle;
@@ -330,11 +812,52 @@ struct Data {
   sf::Clock clock;
   float delta{0.f};
   int fps{0};
+  size_t frame_index{0}; // advanced by every display(), presented or not
   std::string title{"sfml-helper"};
+  sf::Clock title_clock;
+  char title_text[128]{};
+  bool title_updated{false}; // setTitle() was called this frame
   sf::Vector2f _mpos;
   float _mouse_scroll{0.f};
   Resource_manager res_man;
+  Asset_id default_font_id;
+  Text_size_cache text_sizes;
+  // untextured primitives from draw_rect/circle/line/point, submitted in one
+  // draw call before anything that could change the render states or view
+  sf::VertexArray primitives{sf::Triangles};
+  // glyphs of the last draw_text() call, reused so drawing text doesn't
+  // allocate
+  sf::VertexArray text_vertices{sf::Triangles};
   int s_width, s_height, width, height, scale;
+  Render_mode render_mode{Render_mode::Upscaled};
+  std::vector<std::unique_ptr<Layer>> layers;
+  Layer *active_layer{nullptr};
+  const sf::FloatRect *layer_clip{nullptr}; // region of active_layer
+  // on-demand rendering
+  bool on_demand{false};
+  bool redraw_requested{true};
+  // a layer was redrawn, something was drawn outside the layers or an event
+  // arrived; display() doesn't present frames without any of these
+  bool frame_changed{true};
+  size_t frames_skipped{0}; // display() calls that didn't present
+  std::deque<sf::Event> queued_events;
+  // frame pacing
+  Frame_pacing frame_pacing{Frame_pacing::Vsync};
+  float fps_limit{0.f};
+  sf::Clock pacing_clock;
+  sf::Time last_present{}, frame_start{};
+  float present_interval{1.f / DEFAULT_REFRESH_RATE}; // EMA, seconds
+  float frame_work{0.f};                              // EMA, seconds
+  // poll time of each keystroke not yet presented, and how long they took
+  std::vector<sf::Time> pending_inputs;
+  Latency_histogram input_latency;
+  // render stats
+  Render_stats frame_stats, last_frame_stats;
+  size_t frame_allocations{0}, allocations_at_present{0};
+  size_t stats_frame{0};
+  const sf::Texture *last_texture{nullptr};
+  const sf::Shader *last_shader{nullptr};
+  std::ofstream stats_csv;
   sf::Vector2f camera{0.f, 0.f}, to_camera{0.f, 0.f};
   sf::View _camera_view;
   float _camera_zoom{1.f};
@@ -351,8 +874,19 @@ struct Data {
   void clear(const sf::Color &col = sf::Color(0, 0, 0, 255));
   bool init(int s_w, int s_h, int scl, const std::string &title);
   void display();
-
-  // drawing functions {calls ren_tex.draw()}
+  void present();
+  // last Profiler::FRAME_HISTORY frame times as bars; needs SH_PROFILER
+  void draw_frame_graph(const sf::Vector2f &pos, const sf::Vector2f &size);
+
+  // where drawing ends up; the window itself in Render_mode::Direct
+  sf::RenderTarget &render_target();
+  Render_mode get_render_mode() const;
+
+  // drawing functions {calls render_target().draw()}
+  void flush_primitives();
+  void count_draw(size_t vertex_count, const sf::Texture *texture,
+                  const sf::Shader *shader);
+  void count_draw(const sf::Drawable &drawable, const sf::RenderStates &states);
   void draw(const sf::Drawable &drawable,
             const sf::RenderStates &states = sf::RenderStates::Default);
   void draw(const sf::Vertex *vertices, std::size_t vertexCount,
@@ -417,6 +951,32 @@ struct Data {
   sf::Vector2f scr_to_wrld(const sf::Vector2f &p);
   sf::Vector2f wrld_to_scr(const sf::Vector2f &p);
 
+  // on-demand rendering functions
+  void set_on_demand(bool enabled);
+  void request_redraw();
+  // with on-demand rendering, sleeps until an event arrives, a redraw is
+  // requested or `timeout` seconds pass (never if negative); a timed wait
+  // wakes up as soon as input arrives (elsewhere than Windows it checks for
+  // events every millisecond)
+  void wait_for_frame(float timeout = -1.f);
+  // like win.pollEvent(), but also returns events seen by wait_for_frame()
+  bool poll_event(sf::Event &e);
+  // timestamps keystrokes so present() can measure input-to-display latency
+  void note_input(const sf::Event &e);
+
+  // render stats functions
+  // counters of the last displayed frame
+  const Render_stats &render_stats() const;
+  void draw_render_stats(const sf::Vector2f &pos,
+                         unsigned int char_size = DEFAULT_CHAR_SIZE / 2);
+  // appends one csv row per frame to `filename`; an empty name stops
+  bool record_render_stats(const std::string &filename);
+
+  // frame pacing functions
+  void set_frame_pacing(Frame_pacing pacing, float limit = 0.f);
+  // call at the top of the frame, before polling events
+  void pace_frame();
+
   // utility functions
   void handle_close(sf::Event &e);
   float calc_delta();
@@ -429,6 +989,25 @@ struct Data {
   void handle_ipv4(const sf::Event &e, std::string &buf, bool nl = true,
                    bool space = true);
 
+  // layer functions
+  Layer &create_layer();
+  // returns true (and redirects drawing into the layer until end_layer()) if
+  // the layer, or one of its invalidated regions, has to be redrawn:
+  //   while (d.begin_layer(layer)) { draw(); d.end_layer(); }
+  bool begin_layer(Layer &layer);
+  void end_layer();
+  void invalidate(Layer &layer);
+  // redraws only `rect`, given in the coordinates of `view`
+  void invalidate(Layer &layer, const sf::FloatRect &rect,
+                  const sf::View &view);
+  void invalidate(Layer &layer, const sf::FloatRect &rect);
+  // false if `rect` (in the current view) is outside the region being
+  // redrawn, so drawing it can be skipped
+  bool in_layer_region(const sf::FloatRect &rect);
+  // `view` restricted to the region being redrawn
+  sf::View clip_view(const sf::View &view);
+  void draw_layer(const Layer &layer);
+
   // view functions
   void camera_follow(const sf::Vector2f &pos, float rate = 1.f);
   void camera_view();
@@ -439,6 +1018,11 @@ struct Data {
   sf::Vector2f get_text_size(const std::string &text,
                              size_t char_size = DEFAULT_CHAR_SIZE,
                              const sf::Vector2f &padding = {});
+  // rasterises every glyph of `chars` (plus printable ascii) at each size up
+  // front, so sf::Font never has to grow its glyph pages mid-frame
+  size_t prewarm_glyphs(const std::string &chars,
+                        const std::vector<unsigned int> &char_sizes = {
+                            DEFAULT_CHAR_SIZE});
 };
 
 // color --------------------------------------------------
@@ -446,11 +1030,36 @@ namespace col {
 sf::Color inv(const sf::Color &col);
 }; // namespace col
 
+// batch --------------------------------------------------
+// Appends the same geometry the sf shapes/sf::Text used by Data would
+// produce to an sf::Triangles vertex array, so many of them can be submitted
+// in one draw call.
+namespace batch {
+void quad(sf::VertexArray &va, const sf::Vector2f &tl, const sf::Vector2f &br,
+          sf::Color col);
+void rect(sf::VertexArray &va, const sf::Vector2f &pos,
+          const sf::Vector2f &size, sf::Color fill_col, sf::Color out_col,
+          float out_thic);
+void circle(sf::VertexArray &va, const sf::Vector2f &center, float radius,
+            sf::Color fill_col, sf::Color out_col, float out_thic,
+            size_t point_count = 30);
+void line(sf::VertexArray &va, const sf::Vector2f &p1, const sf::Vector2f &p2,
+          sf::Color col1, sf::Color col2, float thic);
+// glyph quads laid out like sf::Text with its origin at `pos`; texture
+// coordinates refer to font.getTexture(char_size)
+void text(sf::VertexArray &va, const sf::Font &font, const std::string &str,
+          unsigned int char_size, const sf::Vector2f &pos, sf::Color col);
+// bottom right corner of sf::Text's local bounds, without building an sf::Text
+sf::Vector2f text_size(const sf::Font &font, const std::string &str,
+                       unsigned int char_size);
+}; // namespace batch
+
 // text_box --------------------------------------------------
 struct Dialog {
   std::string text{};
   std::function<void()> func{nullptr};
   bool func_called{false};
+  std::vector<size_t> line_breaks{}; // indices of chars that start a new line
 };
 
 struct Text_box {
@@ -461,6 +1070,7 @@ struct Text_box {
   std::vector<Dialog> text_buffer;
   int current_text_id{0};
   int current_char{0};
+  size_t current_line{0};
   int char_size{DEFAULT_CHAR_SIZE};
   Alarm char_alarm;
   sf::Vector2f padding{10.f, 5.f};
@@ -474,8 +1084,11 @@ struct Text_box {
   void set_size(const sf::Vector2f &_size);
   bool open_animate();
   bool close_animate();
-  void push_text();
+  bool push_text();
   bool text_fully_drawn() const;
+  // the next line doesn't fit, Space continues on a cleared box
+  bool page_full() const;
+  void next_page();
   void update();
   void draw();
   void add_text(const std::string &txt, std::function<void()> func = nullptr);
@@ -515,9 +1128,73 @@ sf::Vector2f from_radians(float rad);
 #ifdef SFML_HELPER_IMPLEMENTATION
 #define STDCPP_IMPLEMENTATION
 #include <stdcpp.hpp>
+
+#ifdef _WIN32
+// MsgWaitForMultipleObjectsEx, for timed waits in wait_for_frame()
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SH_CRC32C_HW
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SH_CRC32C_TARGET
+#else
+#define SH_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#endif
 namespace sh {
 
 // data.dat --------------------------------------------------
+Data_arena::Data_arena(size_t _size) : size(_size) {
+  block = new char[size];
+  Data_chunk::data_allocated++;
+}
+
+Data_arena::Data_arena(Data_arena &&other) noexcept
+    : block(other.block), size(other.size), used(other.used) {
+  other.block = nullptr;
+  other.size = 0;
+  other.used = 0;
+}
+
+Data_arena &Data_arena::operator=(Data_arena &&other) noexcept {
+  if (this != &other) {
+    free();
+    std::swap(block, other.block);
+    std::swap(size, other.size);
+    std::swap(used, other.used);
+  }
+  return *this;
+}
+
+Data_arena::~Data_arena() { free(); }
+
+char *Data_arena::allocate(size_t n) {
+  ASSERT_MSG(used + n <= size, "Data_arena is out of memory");
+  char *p = block + used;
+  used += n;
+  return p;
+}
+
+void Data_arena::free() {
+  if (block != nullptr) {
+    delete[] block;
+    ASSERT(Data_chunk::data_allocated > 0);
+    Data_chunk::data_allocated--;
+  }
+  block = nullptr;
+  size = 0;
+  used = 0;
+}
+
 void Data_chunk::free() {
   type = Data_type::None;
   data_size = 0;
@@ -526,11 +1203,8 @@ void Data_chunk::free() {
   // d_info(std::format("Chunk `{}` freed!", name));
 #endif
   name.resize(0);
-  if (data != nullptr) {
-    delete data;
-    ASSERT(Data_chunk::data_allocated > 0);
-    Data_chunk::data_allocated--;
-  }
+  data = nullptr;
+  storage.free();
 }
 
 void Data_chunk::allocate(size_t size) {
@@ -538,274 +1212,335 @@ void Data_chunk::allocate(size_t size) {
     WARNING("data is already allocated!\n");
     return;
   }
-  data = new char[size];
-  Data_chunk::data_allocated++;
+  storage = Data_arena(size);
+  data = storage.allocate(size);
 }
 
 size_t Data_chunk::total_size() const {
-  return (sizeof(type) + sizeof(data_size) + sizeof(name_size) + name.size() +
-          data_size);
+  return (sizeof(type) + sizeof(data_size) + sizeof(name_size) + sizeof(crc) +
+          name.size() + data_size);
 }
 
-size_t Data_chunk::data_allocated = 0;
-
-std::vector<std::string> list_of_names_in_data() {
-  std::ifstream ifs;
-  std::vector<std::string> names;
-  if (!fs::exists("data.dat")) {
-    ERR("`data.dat` doesn't exist\n");
+bool Data_chunk::verify() {
+  if (!verified) {
+    verified = crc32c(data, data_size) == crc;
   }
-  ifs.open("data.dat", std::ios::binary | std::ios::in);
-  if (ifs.is_open()) {
+  return verified;
+}
 
-    size_t bytes_read = 0;
-    size_t total_bytes = 0;
-    ifs.seekg(0, std::ios::end);
-    total_bytes = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
+size_t Data_chunk::data_allocated = 0;
 
-    while (bytes_read < total_bytes) {
-
-      // read data type
-      Data_type type = Data_type::Font;
-      ifs.read((char *)&type, sizeof(type));
-      bytes_read += ifs.gcount();
-
-      // read data size
-      size_t data_size = 0;
-      ifs.read((char *)&data_size, sizeof(data_size));
-      bytes_read += ifs.gcount();
-
-      // read name size
-      size_t name_size = 0;
-      ifs.read((char *)&name_size, sizeof(name_size));
-      bytes_read += ifs.gcount();
-
-      // read name
-      std::string name;
-      name.resize(name_size);
-      ifs.read((char *)name.c_str(), name_size);
-      bytes_read += ifs.gcount();
-
-      // read data
-      char *data = new char[data_size];
-      ifs.read((char *)data, data_size);
-      bytes_read += ifs.gcount();
-      delete data;
-
-      if (name_size > 0) {
-        names.push_back(name);
+// crc32c --------------------------------------------------
+struct Crc32c_table {
+  uint32_t t[256];
+  constexpr Crc32c_table() : t() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
       }
+      t[i] = c;
     }
-  } else {
-    ERR("Could not open `data.dat` for input\n");
-    return names;
   }
+};
+static constexpr Crc32c_table crc32c_table{};
+
+static uint32_t crc32c_sw(const char *data, size_t size, uint32_t crc) {
+  for (size_t i = 0; i < size; ++i) {
+    crc = crc32c_table.t[(crc ^ uint8_t(data[i])) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
 
-  ifs.close();
-  return names;
+#ifdef SH_CRC32C_HW
+SH_CRC32C_TARGET static uint32_t crc32c_hw(const char *data, size_t size,
+                                           uint32_t crc) {
+  uint64_t c = crc;
+  while (size >= sizeof(uint64_t)) {
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    c = _mm_crc32_u64(c, v);
+    data += sizeof(v);
+    size -= sizeof(v);
+  }
+  crc = uint32_t(c);
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, uint8_t(*data));
+    data++;
+    size--;
+  }
+  return crc;
 }
 
-std::vector<Data_chunk> list_of_chunks_in_data() {
-  std::vector<Data_chunk> chunks;
+static bool cpu_has_sse42() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
 
-  if (!fs::exists("data.dat")) {
-    ERR("`data.dat` doesn't exist\n");
+uint32_t crc32c(const char *data, size_t size, uint32_t crc) {
+  crc = ~crc;
+#ifdef SH_CRC32C_HW
+  static const bool hw = cpu_has_sse42();
+  if (hw) {
+    return ~crc32c_hw(data, size, crc);
   }
+#endif
+  return ~crc32c_sw(data, size, crc);
+}
 
-  std::ifstream ifs;
-  ifs.open("data.dat", std::ios::binary);
+bool open_data(std::ifstream &ifs, size_t &total_bytes,
+               const std::string &filename) {
+  if (!fs::exists(filename)) {
+    ERR("`{}` doesn't exist\n", filename);
+  }
 
+  ifs.open(filename, std::ios::binary);
   if (!ifs.is_open()) {
-    ERR("Could not open `data.dat` for input\n");
-    return chunks;
+    ERR("Could not open `{}` for input\n", filename);
+    return false;
   }
 
-  size_t bytes_read = 0;
-  size_t total_bytes = 0;
   ifs.seekg(0, std::ios::end);
-  total_bytes = ifs.tellg();
+  total_bytes = size_t(ifs.tellg());
   ifs.seekg(0, std::ios::beg);
 
-  while (bytes_read < total_bytes) {
-    Data_chunk chunk{0};
+  // an empty file is an empty pack
+  if (total_bytes == 0) {
+    return true;
+  }
 
-    // read data type
-    ifs.read((char *)&chunk.type, sizeof(chunk.type));
-    bytes_read += ifs.gcount();
+  uint32_t magic = 0, version = 0;
+  ifs.read((char *)&magic, sizeof(magic));
+  ifs.read((char *)&version, sizeof(version));
+  if (!ifs || magic != DATA_MAGIC) {
+    ERR("`{}` is not a data file (or predates checksums), rebuild it with "
+        "wpm-pack\n",
+        filename);
+    return false;
+  }
+  if (version != DATA_VERSION) {
+    ERR("`{}` is version {}, expected version {}\n", filename, version,
+        DATA_VERSION);
+    return false;
+  }
+  return true;
+}
 
-    // read data size
-    ifs.read((char *)&chunk.data_size, sizeof(chunk.data_size));
-    bytes_read += ifs.gcount();
+bool read_chunk_header(std::ifstream &ifs, Data_chunk &chunk,
+                       size_t total_bytes) {
+  size_t start = size_t(ifs.tellg());
+  size_t header_size = sizeof(chunk.type) + sizeof(chunk.data_size) +
+                       sizeof(chunk.name_size) + sizeof(chunk.crc);
+  if (start > total_bytes || total_bytes - start < header_size) {
+    ERR("Data file is truncated: chunk header at byte {} is cut off\n", start);
+    return false;
+  }
 
-    // read name size
-    ifs.read((char *)&chunk.name_size, sizeof(chunk.name_size));
-    bytes_read += ifs.gcount();
+  ifs.read((char *)&chunk.type, sizeof(chunk.type));
+  ifs.read((char *)&chunk.data_size, sizeof(chunk.data_size));
+  ifs.read((char *)&chunk.name_size, sizeof(chunk.name_size));
+  ifs.read((char *)&chunk.crc, sizeof(chunk.crc));
+  size_t bytes_left = total_bytes - start - header_size;
 
-    // read name
-    ASSERT(chunk.name_size > 0);
-    chunk.name.resize(chunk.name_size);
-    ifs.read((char *)chunk.name.c_str(), chunk.name_size);
-    bytes_read += ifs.gcount();
+  // validate sizes before trusting them with an allocation
+  if (chunk.type < Data_type::Font || chunk.type > Data_type::Alias) {
+    ERR("Data file is corrupt: chunk at byte {} has unknown type {}\n", start,
+        int(chunk.type));
+    return false;
+  }
+  if (chunk.name_size == 0 || chunk.name_size > bytes_left) {
+    ERR("Data file is corrupt: chunk at byte {} has a bad name size ({})\n",
+        start, chunk.name_size);
+    return false;
+  }
+  chunk.name.resize(chunk.name_size);
+  ifs.read((char *)chunk.name.c_str(), chunk.name_size);
+  bytes_left -= chunk.name_size;
+
+  // empty assets are fine, an alias always names its target
+  if ((chunk.data_size == 0 && chunk.type == Data_type::Alias) ||
+      chunk.data_size > bytes_left) {
+    ERR("Data file is truncated: chunk `{}` claims {} bytes but only {} "
+        "remain\n",
+        chunk.name, chunk.data_size, bytes_left);
+    return false;
+  }
 
-    // read data
-    ASSERT(chunk.data_size > 0);
-    chunk.allocate(chunk.data_size);
-    ifs.read((char *)chunk.data, chunk.data_size);
-    bytes_read += ifs.gcount();
+  chunk.offset = start + header_size + chunk.name_size;
+  return true;
+}
 
-    chunks.push_back(chunk);
-  }
+void write_data_header(std::ofstream &ofs) {
+  uint32_t magic = DATA_MAGIC, version = DATA_VERSION;
+  ofs.write((char *)&magic, sizeof(magic));
+  ofs.write((char *)&version, sizeof(version));
+}
 
-  return chunks;
+void write_chunk(std::ofstream &ofs, Data_type type, const std::string &name,
+                 const char *data, size_t data_size, uint32_t crc) {
+  size_t name_size = name.size();
+  ofs.write((char *)&type, sizeof(type));
+  ofs.write((char *)&data_size, sizeof(data_size));
+  ofs.write((char *)&name_size, sizeof(name_size));
+  ofs.write((char *)&crc, sizeof(crc));
+  ofs.write(name.c_str(), name_size);
+  ofs.write(data, data_size);
 }
 
-bool remove_chunk_from_data(const std::string &_name) {
-  bool found = false;
-  for (auto &name : list_of_names_in_data()) {
-    found |= name == _name;
+std::vector<std::string> list_of_names_in_data(const std::string &filename) {
+  std::vector<std::string> names;
+  std::ifstream ifs;
+  size_t total_bytes = 0;
+  if (!open_data(ifs, total_bytes, filename)) {
+    return names;
   }
-  if (!found) {
-    WARNING(FMT("Chunk named `{}` doesn't exist!\n", _name));
-    return true;
+
+  while (size_t(ifs.tellg()) < total_bytes) {
+    Data_chunk chunk{};
+    if (!read_chunk_header(ifs, chunk, total_bytes)) {
+      return names;
+    }
+    // skip data
+    ifs.seekg(chunk.data_size, std::ios::cur);
+    names.push_back(chunk.name);
   }
 
+  return names;
+}
+
+Data_pack list_of_chunks_in_data(const std::string &filename) {
+  Data_pack pack;
   std::ifstream ifs;
-  ifs.open("data.dat", std::ios::binary);
-  char *data = nullptr;
-  size_t data_size = 0;
+  size_t total_bytes = 0;
+  if (!open_data(ifs, total_bytes, filename)) {
+    return pack;
+  }
 
-  char *previous_data_file = nullptr;
-  char *new_data_file = nullptr;
+  // the payloads are always smaller than the file
+  if (total_bytes > 0) {
+    pack.arena = Data_arena(total_bytes);
+  }
 
-  if (ifs.is_open()) {
-    // allocate previous data file state to memory
-    ifs.seekg(0, std::ios::end);
-    size_t previous_data_file_size = ifs.tellg();
-    if (previous_data_file_size <= 0) {
-      ERR("`data.dat` is empty!\n");
-      return false;
+  while (size_t(ifs.tellg()) < total_bytes) {
+    Data_chunk chunk{};
+    if (!read_chunk_header(ifs, chunk, total_bytes)) {
+      return pack;
     }
-    previous_data_file = new char[previous_data_file_size];
-
-    ifs.seekg(0, std::ios::beg);
-
-    ifs.read(previous_data_file, previous_data_file_size);
-    ifs.seekg(0, std::ios::beg);
 
-    bool found = false;
-    size_t found_start = 0;
-    size_t found_size = 0;
+    // read data
+    chunk.data = pack.arena.allocate(chunk.data_size);
+    ifs.read((char *)chunk.data, chunk.data_size);
 
-    size_t bytes_read = 0;
-    size_t total_bytes = 0;
-    ifs.seekg(0, std::ios::end);
-    total_bytes = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
+    pack.chunks.push_back(std::move(chunk));
+  }
 
-    while (bytes_read < total_bytes) {
-      // record start of data
-      found_start = ifs.tellg();
-      found_size = 0;
-
-      // read data type
-      Data_type type = Data_type::Font;
-      ifs.read((char *)&type, sizeof(type));
-      ASSERT(ifs.gcount() == sizeof(type));
-      size_t gcount = ifs.gcount();
-      found_size += gcount;
-      bytes_read += gcount;
-
-      // read data size
-      ifs.read((char *)&data_size, sizeof(data_size));
-      ASSERT(ifs.gcount() == sizeof(data_size));
-      gcount = ifs.gcount();
-      found_size += gcount;
-      bytes_read += gcount;
-
-      // read name size
-      size_t name_size = 0;
-      ifs.read((char *)&name_size, sizeof(name_size));
-      ASSERT(ifs.gcount() == sizeof(name_size));
-      gcount = ifs.gcount();
-      found_size += gcount;
-      bytes_read += gcount;
-
-      // read name
-      std::string name;
-      name.resize(name_size);
-      ifs.read((char *)name.c_str(), name_size);
-      ASSERT(ifs.gcount() == name_size);
-      gcount = ifs.gcount();
-      found_size += gcount;
-      bytes_read += gcount;
-
-      // read data
-      data = new char[data_size];
-      ifs.read(data, data_size);
-      ASSERT(ifs.gcount() == data_size);
-      gcount = ifs.gcount();
-      found_size += gcount;
-      bytes_read += gcount;
-
-      // break if name is found
-      found = (name_size > 0 ? name == _name : false);
-      if (found)
-        break;
+  // resolve aliases to a view of the chunk they point to
+  for (auto &ch : pack.chunks) {
+    if (ch.type != Data_type::Alias)
+      continue;
+
+    std::string target_name(ch.data, ch.data_size);
+    auto target =
+        std::find_if(pack.chunks.begin(), pack.chunks.end(), [&](auto &c) {
+          return c.type != Data_type::Alias && c.name == target_name;
+        });
+    if (target == pack.chunks.end()) {
+      ERR("Alias `{}` points to missing chunk `{}`\n", ch.name, target_name);
     }
-    ifs.close();
 
-    // remove the data found
-    if (found) {
-      ASSERT(0 <= found_start && found_start < previous_data_file_size);
-
-      new_data_file[found_start];
-
-      // pre = [  ][  ][  ][  ][  ][  ]
-      //           ^  ^
-      //  found start end
-      // new = [  ][  ][  ][  ][  ]
-      //           ^
-      size_t new_data_file_size = previous_data_file_size - found_size;
-      new_data_file = new char[new_data_file_size];
+    ch.type = target->type;
+    ch.data = target->data;
+    ch.data_size = target->data_size;
+    ch.crc = target->crc;
+    ch.offset = target->offset;
+    ch.verified = target->verified;
+  }
 
-      memcpy(new_data_file, previous_data_file, new_data_file_size);
+  return pack;
+}
 
-      memcpy(new_data_file + found_start,
-             previous_data_file + found_start + found_size,
-             (previous_data_file_size - (found_start + found_size)));
+bool remove_chunk_from_data(const std::string &_name) {
+  std::ifstream ifs;
+  size_t total_bytes = 0;
+  if (!open_data(ifs, total_bytes)) {
+    return false;
+  }
 
-      // output new data to data.dat
-      if (new_data_file != nullptr) {
+  // find the byte range of the chunk and the aliases that point to it
+  bool found = false;
+  size_t found_start = 0;
+  size_t found_size = 0;
+  std::vector<std::string> aliases;
+  std::string target;
+  while (size_t(ifs.tellg()) < total_bytes) {
+    size_t start = size_t(ifs.tellg());
+    Data_chunk chunk{};
+    if (!read_chunk_header(ifs, chunk, total_bytes)) {
+      return false;
+    }
+    if (chunk.type == Data_type::Alias) {
+      target.resize(chunk.data_size);
+      ifs.read(target.data(), chunk.data_size);
+      if (target == _name && chunk.name != _name)
+        aliases.push_back(chunk.name);
+    } else {
+      ifs.seekg(chunk.data_size, std::ios::cur);
+    }
 
-        WARNING("Overwriting the data.dat file!\n");
-        std::ofstream ofs;
-        ofs.open("data.dat", std::ios::binary);
-        if (ofs.is_open()) {
+    if (!found && chunk.name == _name) {
+      found = true;
+      found_start = start;
+      found_size = size_t(ifs.tellg()) - start;
+    }
+  }
 
-          ofs.write(new_data_file, new_data_file_size);
+  if (!found) {
+    WARNING(FMT("Chunk named `{}` doesn't exist!\n", _name));
+    return true;
+  }
 
-          delete new_data_file;
-          delete previous_data_file;
+  // removing it would leave these aliases dangling
+  if (!aliases.empty()) {
+    std::string names;
+    for (auto &a : aliases)
+      names += FMT(" `{}`", a);
+    WARNING(FMT("Chunk `{}` is aliased by{}; remove those first\n", _name,
+                names));
+    return false;
+  }
 
-          // d_info(std::format(
-          // "Successfully removed `{}` ({} bytes) from `data.dat`", _name,
-          // found_size));
-          return true;
-          ofs.close();
-        } else {
-          ERR("Could not open `data.dat` for output\n");
-          return false;
-        }
-      }
-    }
+  // pre = [  ][  ][  ][  ][  ][  ]
+  //           ^  ^
+  //  found start end
+  // new = [  ][  ][  ][  ][  ]
+  //           ^
+  std::vector<char> new_data_file(total_bytes - found_size);
+  ifs.seekg(0, std::ios::beg);
+  ifs.read(new_data_file.data(), found_start);
+  ifs.seekg(found_start + found_size, std::ios::beg);
+  ifs.read(new_data_file.data() + found_start,
+           total_bytes - (found_start + found_size));
+  ifs.close();
 
-    ERR("Could not find `{}` in `data.dat`\n", _name);
-    return false;
-  } else {
-    ERR("Could not open `data.dat` for input\n");
+  WARNING("Overwriting the data.dat file!\n");
+  std::ofstream ofs;
+  ofs.open("data.dat", std::ios::binary);
+  if (!ofs.is_open()) {
+    ERR("Could not open `data.dat` for output\n");
     return false;
   }
+  ofs.write(new_data_file.data(), new_data_file.size());
+
+  // d_info(std::format(
+  // "Successfully removed `{}` ({} bytes) from `data.dat`", _name,
+  // found_size));
+  return true;
 }
 
 bool remove_all_chunks_from_data() {
@@ -815,6 +1550,7 @@ bool remove_all_chunks_from_data() {
     ERR("Could not open `data.dat` for output\n");
     return false;
   }
+  write_data_header(ofs);
   WARNING("`data.dat` cleared\n");
   ofs.close();
   return true;
@@ -831,16 +1567,14 @@ bool write_chunk_to_data(const Data_type &type, const std::string &filename) {
   std::ifstream ifs;
   ifs.open(filename, std::ios::binary);
 
-  char *data = nullptr;
-  size_t data_size = 0;
+  std::vector<char> data;
 
   if (ifs.is_open()) {
     ifs.seekg(0, std::ios::end);
-    data_size = ifs.tellg();
+    data.resize(size_t(ifs.tellg()));
     ifs.seekg(0, std::ios::beg);
-    data = new char[data_size];
 
-    ifs.read((char *)data, data_size);
+    ifs.read(data.data(), data.size());
 
     ifs.close();
   } else {
@@ -848,43 +1582,27 @@ bool write_chunk_to_data(const Data_type &type, const std::string &filename) {
     return false;
   }
 
+  if (data.empty()) {
+    ERR("`{}` is empty\n", filename);
+    return false;
+  }
+
+  bool empty_data_file = fs::file_size("data.dat") == 0;
+
   std::ofstream ofs;
   ofs.open("data.dat", std::ios::app | std::ios::binary);
 
   if (ofs.is_open()) {
-    ofs.seekp(0, std::ios::end);
-    // d_info(std::format<size_t>(
-    //     "`data.dat` contains {} bytes of data before writing `{}`",
-    //     ofs.tellp(), filename));
-    ofs.seekp(0, std::ios::beg);
-
-    size_t bytes_written = 0;
-
-    // write data type
-    ofs.write((char *)&type, sizeof(type));
-    bytes_written += sizeof(type);
-
-    // write data size
-    ofs.write((char *)&data_size, sizeof(data_size));
-    bytes_written += sizeof(data_size);
-
-    // write name size
-    size_t name_size = filename.size();
-    ofs.write((char *)&name_size, sizeof(name_size));
-    bytes_written += sizeof(name_size);
-
-    // write name
-    ofs.write((char *)filename.c_str(), name_size);
-    bytes_written += name_size;
+    if (empty_data_file) {
+      write_data_header(ofs);
+    }
 
-    // write data
-    ofs.write((char *)data, data_size);
-    bytes_written += data_size;
+    write_chunk(ofs, type, filename, data.data(), data.size(),
+                crc32c(data.data(), data.size()));
 
     // d_info(std::format("Successfully written `{}` ({} bytes) to `data.dat`",
-    // filename, bytes_written));
+    // filename, chunk.total_size()));
     return true;
-    ofs.close();
   } else {
     ERR("Could not open `data.dat` for output\n");
     return false;
@@ -910,42 +1628,18 @@ bool write_shader_to_data(const std::string &filename) {
 
 bool read_chunk_from_data(Data_chunk &chunk, const std::string &name,
                           Data_type type) {
-  auto chunks = list_of_chunks_in_data();
-  if (chunks.empty()) {
-    ERR("No chunk(s) found in `data.dat`\n");
-    return false;
-  }
-
-  bool found = false;
-  bool found_type = false;
-  bool found_name = false;
-  bool check_type = type != Data_type::None;
-  int found_idx = -1;
-  for (size_t i = 0; i < chunks.size(); ++i) {
-    auto &ch = chunks.at(i);
-
-    if (check_type) {
-      found_type = ch.type == type;
-    }
-    found_name = ch.name == name;
-
-    if (check_type) {
-      found = found_name && found_type;
-    } else {
-      found = found_name;
-    }
-    if (found) {
-      found_idx = int(i);
-      chunk = ch;
-      break;
-    }
-  }
-
-  // free unwanted allocated chunks
-  for (size_t i = 0; i < chunks.size(); ++i) {
-    if (i != found_idx) {
-      chunks.at(i).free();
+  // read just this chunk's payload into its own storage
+  bool found = find_chunk_in_data(chunk, name, type);
+  if (found) {
+    std::ifstream ifs;
+    ifs.open("data.dat", std::ios::binary);
+    if (!ifs.is_open()) {
+      ERR("Could not open `data.dat` for input\n");
+      return false;
     }
+    chunk.allocate(chunk.data_size);
+    ifs.seekg(chunk.offset, std::ios::beg);
+    ifs.read(chunk.data, chunk.data_size);
   }
 
   std::string type_str;
@@ -966,6 +1660,9 @@ bool read_chunk_from_data(Data_chunk &chunk, const std::string &name,
   case Data_type::Shader:
     type_str = "shader";
     break;
+  case Data_type::Alias:
+    type_str = "alias";
+    break;
   default:
     UNREACHABLE();
     break;
@@ -974,6 +1671,10 @@ bool read_chunk_from_data(Data_chunk &chunk, const std::string &name,
   if (!found) {
     ERR("Could not find {} `{}` in `data.dat`\n", type_str, name);
     return false;
+  } else if (!chunk.verify()) {
+    ERR("{} `{}` failed its checksum, `data.dat` is corrupt\n", type_str,
+        name);
+    return false;
   } else {
     // d_info(std::format("Successfully read {} `{}` ({}
     // bytes) from `data.dat`",
@@ -999,18 +1700,9 @@ bool read_shader_from_data(Data_chunk &chunk, const std::string &filename) {
 }
 
 bool chunk_exists_in_data(const std::string &filename) {
-  std::vector<Data_chunk> chunks = list_of_chunks_in_data();
   bool found = false;
-
-  if (chunks.empty()) {
-    // d_info(std::format("Chunk `{}` doesn't exist!",
-    // filename));
-    return found;
-  }
-
-  for (auto &ch : chunks) {
-    found |= ch.name == filename;
-    ch.free();
+  for (auto &name : list_of_names_in_data()) {
+    found |= name == filename;
   }
 
   if (found) {
@@ -1020,11 +1712,605 @@ bool chunk_exists_in_data(const std::string &filename) {
   return found;
 }
 
+bool find_chunk_in_data(Data_chunk &chunk, const std::string &name,
+                        Data_type type, const std::string &filename) {
+  std::ifstream ifs;
+  size_t total_bytes = 0;
+  if (!open_data(ifs, total_bytes, filename)) {
+    return false;
+  }
+
+  std::string wanted = name;
+  bool followed_alias = false;
+  while (size_t(ifs.tellg()) < total_bytes) {
+    Data_chunk ch{};
+    if (!read_chunk_header(ifs, ch, total_bytes)) {
+      return false;
+    }
+
+    if (ch.type == Data_type::Alias) {
+      // aliases always come after their target, so rescan from the start.
+      // Like `list_of_chunks_in_data`, an alias only resolves to a real
+      // chunk, so a self-alias or an alias cycle can't loop forever.
+      if (ch.name == wanted && !followed_alias) {
+        followed_alias = true;
+        wanted.resize(ch.data_size);
+        ifs.read((char *)wanted.c_str(), ch.data_size);
+        ifs.seekg(sizeof(uint32_t) * 2, std::ios::beg);
+        continue;
+      }
+      ifs.seekg(ch.data_size, std::ios::cur);
+      continue;
+    }
+
+    if (ch.name == wanted && (type == Data_type::None || ch.type == type)) {
+      ch.name = name;
+      ch.name_size = name.size();
+      chunk = std::move(ch);
+      return true;
+    }
+    ifs.seekg(ch.data_size, std::ios::cur);
+  }
+
+  return false;
+}
+
+// data_stream --------------------------------------------------
+bool Data_stream::open(const std::string &name, Data_type type,
+                       const std::string &filename) {
+  if (!find_chunk_in_data(chunk, name, type, filename)) {
+    ERR("Could not find `{}` in `{}`\n", name, filename);
+    return false;
+  }
+
+  ifs.open(filename, std::ios::binary);
+  if (!ifs.is_open()) {
+    ERR("Could not open `{}` for input\n", filename);
+    return false;
+  }
+  return seek(0) == 0;
+}
+
+bool Data_stream::verify() {
+  if (chunk.verified) {
+    return true;
+  }
+
+  char buffer[16 * 1024];
+  uint32_t crc = 0;
+  sf::Int64 prev_pos = tell();
+  seek(0);
+  while (true) {
+    sf::Int64 n = read(buffer, sizeof(buffer));
+    if (n <= 0)
+      break;
+    crc = crc32c(buffer, size_t(n), crc);
+  }
+  seek(prev_pos);
+
+  chunk.verified = crc == chunk.crc;
+  return chunk.verified;
+}
+
+sf::Int64 Data_stream::read(void *data, sf::Int64 size) {
+  sf::Int64 count = std::min(size, getSize() - pos);
+  if (count <= 0) {
+    return 0;
+  }
+  ifs.read((char *)data, count);
+  count = ifs.gcount();
+  pos += count;
+  return count;
+}
+
+sf::Int64 Data_stream::seek(sf::Int64 position) {
+  if (position < 0 || position > getSize()) {
+    return -1;
+  }
+  ifs.clear();
+  ifs.seekg(chunk.offset + position, std::ios::beg);
+  pos = position;
+  return pos;
+}
+
+sf::Int64 Data_stream::tell() { return pos; }
+
+sf::Int64 Data_stream::getSize() { return sf::Int64(chunk.data_size); }
+
+// thread_pool --------------------------------------------------
+Thread_pool::Thread_pool(size_t count) {
+  if (count == 0) {
+    count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    workers.emplace_back([this]() {
+      while (true) {
+        std::function<void()> job;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          job_cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+          if (stopping && jobs.empty())
+            return;
+          job = std::move(jobs.front());
+          jobs.pop_front();
+          busy++;
+        }
+
+        job();
+
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          busy--;
+          if (busy == 0 && jobs.empty())
+            done_cv.notify_all();
+        }
+      }
+    });
+  }
+}
+
+Thread_pool::~Thread_pool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_cv.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+void Thread_pool::push(std::function<void()> job) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  job_cv.notify_one();
+}
+
+void Thread_pool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [this]() { return busy == 0 && jobs.empty(); });
+}
+
+void Thread_pool::parallel_for(size_t count,
+                               const std::function<void(size_t)> &func) {
+  // waits on its own jobs only, other work may still be queued
+  std::latch done{ptrdiff_t(count)};
+  for (size_t i = 0; i < count; ++i) {
+    push([&func, &done, i]() {
+      func(i);
+      done.count_down();
+    });
+  }
+  done.wait();
+}
+
+// profiler --------------------------------------------------
+std::mutex Profiler::rings_mutex;
+std::vector<std::unique_ptr<Profiler::Thread_ring>> Profiler::rings;
+float Profiler::frame_ms[Profiler::FRAME_HISTORY]{};
+size_t Profiler::frame_count{0};
+
+uint64_t Profiler::now_ns() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - epoch)
+                      .count());
+}
+
+Profiler::Thread_ring &Profiler::ring() {
+  // rings outlive their threads so an export never reads freed memory
+  thread_local Thread_ring *local = nullptr;
+  if (!local) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(std::make_unique<Thread_ring>());
+    local = rings.back().get();
+    local->tid = uint32_t(rings.size() - 1);
+  }
+  return *local;
+}
+
+void Profiler::record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+  Thread_ring &r = ring();
+  const size_t head = r.head.load(std::memory_order_relaxed);
+  r.events[head % RING_SIZE] = {name, start_ns, end_ns};
+  r.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::frame(float delta) {
+  frame_ms[frame_count % FRAME_HISTORY] = delta * 1000.f;
+  frame_count++;
+}
+
+bool Profiler::export_chrome_trace(const std::string &filename) {
+  std::ofstream ofs(filename, std::ios::out | std::ios::trunc);
+  if (!ofs.is_open()) {
+    WARNING(FMT("Could not open `{}` for writing\n", filename));
+    return false;
+  }
+
+  // chrome://tracing / perfetto "complete" events, timestamps in us
+  size_t written = 0;
+  ofs << "{\"traceEvents\":[";
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  for (const auto &r : rings) {
+    const size_t head = r->head.load(std::memory_order_acquire);
+    const size_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+    for (size_t i = first; i < head; ++i) {
+      const Profile_event &e = r->events[i % RING_SIZE];
+      fprint(ofs,
+             "{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,\"tid\":{},"
+             "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+             written == 0 ? "" : ",", e.name, r->tid,
+             double(e.start_ns) / 1000.0,
+             double(e.end_ns - e.start_ns) / 1000.0);
+      written++;
+    }
+  }
+  ofs << "]}\n";
+
+  print("Wrote {} profile events to `{}`\n", written, filename);
+  return true;
+}
+
+Profile_scope::Profile_scope(const char *_name)
+    : name(_name), start_ns(Profiler::now_ns()) {}
+
+Profile_scope::~Profile_scope() {
+  Profiler::record(name, start_ns, Profiler::now_ns());
+}
+
+// allocation tracking --------------------------------------------------
+std::atomic<size_t> Alloc_stats::allocations{0};
+std::atomic<size_t> Alloc_stats::frees{0};
+std::atomic<size_t> Alloc_stats::bytes{0};
+thread_local size_t Alloc_stats::thread_allocations{0};
+thread_local size_t Alloc_stats::thread_bytes{0};
+
+Alloc_scope::Alloc_scope()
+    : start_allocations(Alloc_stats::thread_allocations),
+      start_bytes(Alloc_stats::thread_bytes) {}
+
+size_t Alloc_scope::allocations() const {
+  return Alloc_stats::thread_allocations - start_allocations;
+}
+
+size_t Alloc_scope::bytes() const {
+  return Alloc_stats::thread_bytes - start_bytes;
+}
+
+// pack --------------------------------------------------
+Data_type data_type_from_extension(const std::string &filename) {
+  std::string ext = fs::path(filename).extension().string();
+  ::str::tolower(ext);
+
+  if (ext == ".ttf" || ext == ".otf")
+    return Data_type::Font;
+  if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" ||
+      ext == ".tga")
+    return Data_type::Texture;
+  if (ext == ".wav" || ext == ".ogg" || ext == ".flac")
+    return Data_type::Sound;
+  if (ext == ".frag" || ext == ".vert" || ext == ".geom" || ext == ".glsl")
+    return Data_type::Shader;
+  return Data_type::None;
+}
+
+bool pack_entries_from_dir(std::vector<Pack_entry> &entries,
+                           const std::string &dir) {
+  if (!fs::is_directory(dir)) {
+    ERR("`{}` is not a directory\n", dir);
+    return false;
+  }
+
+  for (auto &file : fs::recursive_directory_iterator(dir)) {
+    if (!file.is_regular_file())
+      continue;
+
+    std::string name = file.path().generic_string();
+    Data_type type = data_type_from_extension(name);
+    if (type == Data_type::None) {
+      WARNING(FMT("Skipping `{}`: unknown asset type\n", name));
+      continue;
+    }
+    entries.push_back({type, name});
+  }
+  return true;
+}
+
+bool pack_entries_from_manifest(std::vector<Pack_entry> &entries,
+                                const std::string &manifest) {
+  std::ifstream ifs;
+  ifs.open(manifest);
+  if (!ifs.is_open()) {
+    ERR("Could not open `{}` for input\n", manifest);
+    return false;
+  }
+
+  /* manifest format, one asset per line:
+     [font|texture|sound|shader] <path>
+     <path>                            (type inferred from the extension)
+     # comment
+   */
+  std::string line;
+  size_t line_num = 0;
+  while (std::getline(ifs, line)) {
+    line_num++;
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::string type_str, name;
+    size_t space = line.find(' ');
+    if (space == std::string::npos) {
+      name = line;
+    } else {
+      type_str = line.substr(0, space);
+      name = line.substr(space + 1);
+    }
+
+    Data_type type = Data_type::None;
+    if (type_str.empty())
+      type = data_type_from_extension(name);
+    else if (type_str == "font")
+      type = Data_type::Font;
+    else if (type_str == "texture")
+      type = Data_type::Texture;
+    else if (type_str == "sound")
+      type = Data_type::Sound;
+    else if (type_str == "shader")
+      type = Data_type::Shader;
+
+    if (type == Data_type::None) {
+      ERR("{}:{}: Unknown asset type for `{}`\n", manifest, line_num, line);
+      return false;
+    }
+    entries.push_back({type, name});
+  }
+  return true;
+}
+
+bool write_pack(std::vector<Pack_entry> &entries, const std::string &filename) {
+  sf::Clock clock;
+
+  // group chunks by type so loaders that scan one type read adjacent bytes;
+  // a file listed twice with the same type is packed once
+  std::sort(entries.begin(), entries.end(), [](auto &a, auto &b) {
+    if (a.type != b.type)
+      return a.type < b.type;
+    return a.name < b.name;
+  });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](auto &a, auto &b) {
+                              return a.type == b.type && a.name == b.name;
+                            }),
+                entries.end());
+
+  // chunks are looked up by name alone, so a name can't have two types
+  std::unordered_map<std::string, Data_type> types;
+  for (auto &e : entries) {
+    auto [it, inserted] = types.try_emplace(e.name, e.type);
+    if (!inserted) {
+      ERR("`{}` is packed as two different types ({} and {}), chunk names "
+          "must be unique\n",
+          e.name, int(it->second), int(e.type));
+      return false;
+    }
+  }
+
+  // read and hash every input on the pool
+  {
+    Thread_pool pool;
+    pool.parallel_for(entries.size(), [&](size_t i) {
+      auto &e = entries[i];
+      std::ifstream ifs;
+      ifs.open(e.name, std::ios::binary);
+      if (!ifs.is_open())
+        return;
+      ifs.seekg(0, std::ios::end);
+      const std::streamoff size = ifs.tellg();
+      if (size < 0)
+        return;
+      e.data.resize(size_t(size));
+      ifs.seekg(0, std::ios::beg);
+      if (!ifs.read(e.data.data(), e.data.size()))
+        return;
+      e.hash = hash_fnv1a(e.data.data(), e.data.size());
+      e.crc = crc32c(e.data.data(), e.data.size());
+      e.read = true;
+    });
+  }
+  for (auto &e : entries) {
+    if (!e.read) {
+      ERR("Could not read `{}`\n", e.name);
+      return false;
+    }
+  }
+  float read_time = clock.restart().asSeconds();
+
+  // dedupe identical payloads
+  size_t input_bytes = 0;
+  std::unordered_map<uint64_t, std::vector<int>> by_hash;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto &e = entries[i];
+    input_bytes += e.data.size();
+    for (int other : by_hash[e.hash]) {
+      if (entries[other].data == e.data) {
+        e.alias_of = other;
+        break;
+      }
+    }
+    if (e.alias_of == -1) {
+      by_hash[e.hash].push_back(int(i));
+    }
+  }
+
+  std::ofstream ofs;
+  ofs.open(filename, std::ios::binary);
+  if (!ofs.is_open()) {
+    ERR("Could not open `{}` for output\n", filename);
+    return false;
+  }
+
+  write_data_header(ofs);
+
+  // payloads first, then the aliases that refer back to them
+  size_t unique_count = 0;
+  for (auto &e : entries) {
+    if (e.alias_of != -1)
+      continue;
+    write_chunk(ofs, e.type, e.name, e.data.data(), e.data.size(), e.crc);
+    unique_count++;
+  }
+  for (auto &e : entries) {
+    if (e.alias_of == -1)
+      continue;
+    const std::string &target = entries[e.alias_of].name;
+    write_chunk(ofs, Data_type::Alias, e.name, target.c_str(), target.size(),
+                crc32c(target.c_str(), target.size()));
+  }
+
+  size_t output_bytes = size_t(ofs.tellp());
+  ofs.close();
+  float write_time = clock.restart().asSeconds();
+
+  auto mb_per_s = [](size_t bytes, float s) {
+    return (float(bytes) / (1024.f * 1024.f)) / std::fmaxf(s, 0.0001f);
+  };
+  print("Packed {} files ({} unique) into `{}`: {} -> {} bytes\n",
+        entries.size(), unique_count, filename, input_bytes, output_bytes);
+  print("  read+hash: {:.3f}s ({:.2f} MB/s)\n", read_time,
+        mb_per_s(input_bytes, read_time));
+  print("  write:     {:.3f}s ({:.2f} MB/s)\n", write_time,
+        mb_per_s(output_bytes, write_time));
+  return true;
+}
+
+bool verify_data(const std::string &filename) {
+  sf::Clock clock;
+  Data_pack pack = list_of_chunks_in_data(filename);
+  std::vector<Data_chunk> &chunks = pack.chunks;
+  std::vector<char> ok(chunks.size(), 0);
+  {
+    Thread_pool pool;
+    pool.parallel_for(chunks.size(),
+                      [&](size_t i) { ok[i] = chunks[i].verify(); });
+  }
+
+  size_t corrupt = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    bytes += chunks[i].data_size;
+    if (!ok[i]) {
+      WARNING(FMT("Chunk `{}` failed its checksum\n", chunks[i].name));
+      corrupt++;
+    }
+  }
+
+  print("Verified {} chunks ({} bytes) of `{}` in {:.3f}s: {} corrupt\n",
+        chunks.size(), bytes, filename, clock.getElapsedTime().asSeconds(),
+        corrupt);
+  return corrupt == 0;
+}
+
+// latency_histogram --------------------------------------------------
+void Latency_histogram::add(float ms) {
+  size_t i = size_t(std::max(0.f, ms) / BUCKET_MS);
+  buckets[std::min(i, BUCKETS - 1)]++;
+  count++;
+  max_ms = std::max(max_ms, ms);
+}
+
+float Latency_histogram::percentile(float p) const {
+  if (count == 0)
+    return 0.f;
+  const size_t rank = std::max(size_t(1), size_t(std::ceil(p * float(count))));
+  size_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return i == BUCKETS - 1 ? max_ms : float(i + 1) * BUCKET_MS;
+  }
+  return max_ms;
+}
+
+void Latency_histogram::reset() { *this = {}; }
+
+// text_size_cache --------------------------------------------------
+static size_t text_size_set(uint64_t hash, const sf::Font *font,
+                            uint32_t char_size) {
+  uint64_t h = hash ^ (uint64_t(char_size) * 0x9e3779b97f4a7c15ULL) ^
+               (uint64_t(uintptr_t(font)) >> 4);
+  return size_t(h ^ (h >> 32)) % Text_size_cache::SETS;
+}
+
+bool Text_size_cache::find(const std::string &text, const sf::Font *font,
+                           uint32_t char_size, sf::Vector2f &size) {
+  if (text.size() > MAX_TEXT) {
+    ++misses;
+    return false;
+  }
+  const uint64_t hash = hash_fnv1a(text.data(), text.size());
+  Entry *set = entries[text_size_set(hash, font, char_size)];
+  for (size_t i = 0; i < WAYS; ++i) {
+    Entry &e = set[i];
+    if (e.stamp != 0 && e.hash == hash && e.font == font &&
+        e.char_size == char_size && e.len == text.size() &&
+        std::memcmp(e.text, text.data(), text.size()) == 0) {
+      e.stamp = ++tick;
+      size = e.size;
+      ++hits;
+      return true;
+    }
+  }
+  ++misses;
+  return false;
+}
+
+void Text_size_cache::insert(const std::string &text, const sf::Font *font,
+                             uint32_t char_size, const sf::Vector2f &size) {
+  if (text.size() > MAX_TEXT)
+    return;
+  const uint64_t hash = hash_fnv1a(text.data(), text.size());
+  Entry *set = entries[text_size_set(hash, font, char_size)];
+  Entry *victim = &set[0];
+  for (size_t i = 1; i < WAYS; ++i) {
+    if (set[i].stamp < victim->stamp)
+      victim = &set[i];
+  }
+  victim->hash = hash;
+  victim->font = font;
+  victim->char_size = char_size;
+  victim->stamp = ++tick;
+  victim->size = size;
+  victim->len = uint32_t(text.size());
+  std::memcpy(victim->text, text.data(), text.size());
+
+  // on wrap around, forget everything rather than mis-order the ways
+  if (tick == UINT32_MAX)
+    clear();
+}
+
+void Text_size_cache::clear() {
+  for (auto &set : entries)
+    for (auto &e : set)
+      e = {};
+  tick = 0;
+}
+
 // data --------------------------------------------------
 
 void Data::clear(const sf::Color &col) {
+  // queued geometry would have been wiped by the clear, unless it belongs to
+  // a layer that isn't being cleared
+  if (active_layer)
+    flush_primitives();
+  else
+    primitives.clear();
   win.clear(col);
-  ren_tex.clear(col);
+  if (render_mode == Render_mode::Upscaled)
+    ren_tex.clear(col);
 }
 
 bool Data::init(int s_w, int s_h, int scl, const std::string &_title) {
@@ -1037,17 +2323,15 @@ bool Data::init(int s_w, int s_h, int scl, const std::string &_title) {
 
   srand(unsigned int(time(0)));
 
-  // std::cout auto-flushes on every output
-  std::cout << std::unitbuf;
-
   // create window
   win.create(sf::VideoMode(s_width, s_height), title,
              sf::Style::Close | sf::Style::Titlebar);
   win.setVerticalSyncEnabled(true);
   win.setKeyRepeatEnabled(true);
 
-  // create render texture
-  if (!ren_tex.create(width, height)) {
+  // an intermediate render texture is only needed to upscale
+  render_mode = scale == 1 ? Render_mode::Direct : Render_mode::Upscaled;
+  if (render_mode == Render_mode::Upscaled && !ren_tex.create(width, height)) {
     ERR("Could not create render texture!\n");
     return false;
   }
@@ -1062,6 +2346,13 @@ bool Data::init(int s_w, int s_h, int scl, const std::string &_title) {
     prev_mouse_pressed[i] = false;
   }
 
+  // keep per-frame containers from growing (and allocating) mid-test
+  primitives.resize(4096);
+  primitives.clear();
+  text_vertices.resize(1024);
+  text_vertices.clear();
+  pending_inputs.reserve(64);
+
   // init camera view
   _camera_view.setSize(float(width), float(height));
   _camera_view.setCenter(ss() / 2.f);
@@ -1079,37 +2370,237 @@ bool Data::init(int s_w, int s_h, int scl, const std::string &_title) {
   }
 
   // load default font
+  res_man.index_data();
   text.setFont(res_man.load_font(DEFAULT_FONT_NAME));
+  default_font_id = res_man.id(ASSET_HASH(DEFAULT_FONT_NAME));
 
-  return res_man.load_all_textures();
+  // textures and other fonts are loaded on first use through
+  // `res_man.texture()` / `res_man.font()` (or `res_man.load_all_textures()`
+  // / `res_man.load_all_fonts()` to load them all up front)
+  return res_man.load_all_shaders();
+}
+
+void Data::present() {
+  const float alpha = 0.1f;
+  const sf::Time work_end = pacing_clock.getElapsedTime();
+  frame_work += ((work_end - frame_start).asSeconds() - frame_work) * alpha;
+
+  win.display();
+
+  // present() runs on the main thread, so this is the main thread's count
+  const size_t allocations = Alloc_stats::thread_allocations;
+  frame_allocations = allocations - allocations_at_present;
+  allocations_at_present = allocations;
+
+  // the window counts as a render target pass too
+  frame_stats.rt_passes++;
+  last_frame_stats = frame_stats;
+  frame_stats = {};
+  last_texture = nullptr;
+  last_shader = nullptr;
+  if (stats_csv.is_open()) {
+    const Render_stats &st = last_frame_stats;
+    fprint(stats_csv, "{},{:.3f},{},{},{},{},{},{}\n", stats_frame,
+           delta * 1000.f, st.draw_calls, st.vertices, st.texture_switches,
+           st.shader_switches, st.view_switches, st.rt_passes);
+  }
+  stats_frame++;
+
+  // with vsync display() returns right after a vblank, so the time between
+  // returns tracks the refresh interval; ignore the long gaps from idling
+  const sf::Time now = pacing_clock.getElapsedTime();
+  const float interval = (now - last_present).asSeconds();
+  if (interval < 0.1f)
+    present_interval += (interval - present_interval) * alpha;
+  last_present = now;
+
+  // everything polled before this frame was drawn is on screen now
+  for (const sf::Time &t : pending_inputs)
+    input_latency.add((now - t).asSeconds() * 1000.f);
+  pending_inputs.clear();
+}
+
+void Data::draw_frame_graph(const sf::Vector2f &pos, const sf::Vector2f &size) {
+  // scaled so a 60hz frame sits in the middle
+  const float max_ms = 2000.f / DEFAULT_REFRESH_RATE;
+  const size_t count = std::min(Profiler::frame_count, Profiler::FRAME_HISTORY);
+  const float bar_w = size.x / float(Profiler::FRAME_HISTORY);
+
+  draw_rect(pos, size, TopLeft, sf::Color(0, 0, 0, 150),
+            sf::Color(255, 255, 255, 100), 1.f);
+  for (size_t i = 0; i < count; ++i) {
+    const size_t frame = Profiler::frame_count - count + i;
+    const float ms = Profiler::frame_ms[frame % Profiler::FRAME_HISTORY];
+    const float h = std::min(ms / max_ms, 1.f) * size.y;
+    const sf::Color col = ms > max_ms / 2.f * 1.05f ? sf::Color::Red
+                                                    : sf::Color::Green;
+    batch::quad(primitives, {pos.x + float(i) * bar_w, pos.y + size.y - h},
+                {pos.x + float(i + 1) * bar_w, pos.y + size.y}, col);
+  }
+  draw_line({pos.x, pos.y + size.y / 2.f}, {pos.x + size.x, pos.y + size.y / 2.f},
+            sf::Color(255, 255, 255, 100));
 }
 
 void Data::display() {
+  PROFILE_SCOPE("display");
+  frame_index++;
+  // swap in assets whose async load finished this frame
+  res_man.update();
+
+  flush_primitives();
+
+  // on demand, a frame that would look like the last one isn't presented
+  if (on_demand && !frame_changed && !redraw_requested) {
+    frames_skipped++;
+    frame_stats = {};
+    last_texture = nullptr;
+    last_shader = nullptr;
+    return;
+  }
+  frame_changed = false;
+  redraw_requested = false;
+
+  if (render_mode == Render_mode::Direct) {
+    present();
+    return;
+  }
+
   ren_tex.display();
 
   ren_rect.setSize(sf::Vector2f((float)s_width, (float)s_height));
   ren_rect.setTexture(&ren_tex.getTexture());
 
+  count_draw(ren_rect, sf::RenderStates::Default);
+  frame_stats.rt_passes++;
   win.draw(ren_rect);
-  win.display();
+  present();
+}
+
+void Data::count_draw(size_t vertex_count, const sf::Texture *texture,
+                      const sf::Shader *shader) {
+  frame_stats.draw_calls++;
+  frame_stats.vertices += vertex_count;
+  if (texture != last_texture) {
+    frame_stats.texture_switches++;
+    last_texture = texture;
+  }
+  if (shader != last_shader) {
+    frame_stats.shader_switches++;
+    last_shader = shader;
+  }
+}
+
+void Data::count_draw(const sf::Drawable &drawable,
+                      const sf::RenderStates &states) {
+  // the vertex count of an arbitrary drawable isn't visible, so look at the
+  // ones sfml-helper itself draws
+  size_t vertex_count = 0;
+  const sf::Texture *texture = states.texture;
+  if (auto *va = dynamic_cast<const sf::VertexArray *>(&drawable)) {
+    vertex_count = va->getVertexCount();
+  } else if (auto *sprite = dynamic_cast<const sf::Sprite *>(&drawable)) {
+    vertex_count = 4;
+    texture = sprite->getTexture();
+  } else if (auto *t = dynamic_cast<const sf::Text *>(&drawable)) {
+    // sf::Text emits no quad for whitespace, and a second set of quads for
+    // the outline
+    for (sf::Uint32 cp : t->getString()) {
+      if (cp != ' ' && cp != '\t' && cp != '\n' && cp != '\r')
+        vertex_count += 6;
+    }
+    if (t->getOutlineThickness() != 0.f)
+      vertex_count *= 2;
+    if (t->getFont())
+      texture = &t->getFont()->getTexture(t->getCharacterSize());
+  } else if (auto *shape = dynamic_cast<const sf::Shape *>(&drawable)) {
+    vertex_count = shape->getPointCount() + 2;
+    if (shape->getOutlineThickness() != 0.f)
+      vertex_count += (shape->getPointCount() + 1) * 2;
+    texture = shape->getTexture();
+  }
+  count_draw(vertex_count, texture, states.shader);
+}
+
+const Render_stats &Data::render_stats() const { return last_frame_stats; }
+
+void Data::draw_render_stats(const sf::Vector2f &pos, unsigned int char_size) {
+  const Render_stats &st = last_frame_stats;
+  draw_text(pos,
+            FMT("draw calls: {}\nvertices: {}\ntexture switches: {}\n"
+                "shader switches: {}\nview switches: {}\nrt passes: {}",
+                st.draw_calls, st.vertices, st.texture_switches,
+                st.shader_switches, st.view_switches, st.rt_passes),
+            TopLeft, int(char_size));
+}
+
+bool Data::record_render_stats(const std::string &filename) {
+  if (stats_csv.is_open())
+    stats_csv.close();
+  if (filename.empty())
+    return true;
+
+  stats_csv.open(filename, std::ios::out | std::ios::trunc);
+  if (!stats_csv.is_open()) {
+    WARNING(FMT("Could not open `{}` for writing\n", filename));
+    return false;
+  }
+  stats_csv << "frame,delta_ms,draw_calls,vertices,texture_switches,"
+               "shader_switches,view_switches,rt_passes\n";
+  return true;
+}
+
+sf::RenderTarget &Data::render_target() {
+  if (active_layer)
+    return active_layer->tex;
+  if (render_mode == Render_mode::Direct)
+    return win;
+  return ren_tex;
+}
+
+Render_mode Data::get_render_mode() const { return render_mode; }
+
+void Data::flush_primitives() {
+  if (primitives.getVertexCount() == 0)
+    return;
+  if (active_layer == nullptr)
+    frame_changed = true;
+  count_draw(primitives, sf::RenderStates::Default);
+  render_target().draw(primitives);
+  primitives.clear();
 }
 
 void Data::draw(const sf::Drawable &drawable, const sf::RenderStates &states) {
-  ren_tex.draw(drawable, states);
+  flush_primitives();
+  if (active_layer == nullptr)
+    frame_changed = true;
+  count_draw(drawable, states);
+  render_target().draw(drawable, states);
 }
 
 void Data::draw(const sf::Vertex *vertices, std::size_t vertexCount,
                 sf::PrimitiveType type, const sf::RenderStates &states) {
-  ren_tex.draw(vertices, vertexCount, type, states);
+  flush_primitives();
+  if (active_layer == nullptr)
+    frame_changed = true;
+  count_draw(vertexCount, states.texture, states.shader);
+  render_target().draw(vertices, vertexCount, type, states);
 }
 
 void Data::draw(const sf::VertexBuffer &vertexBuffer,
                 const sf::RenderStates &states) {
-  ren_tex.draw(vertexBuffer, states);
+  flush_primitives();
+  if (active_layer == nullptr)
+    frame_changed = true;
+  count_draw(vertexBuffer.getVertexCount(), states.texture, states.shader);
+  render_target().draw(vertexBuffer, states);
 }
 void Data::draw(const sf::VertexBuffer &vertexBuffer, std::size_t firstVertex,
                 std::size_t vertexCount, const sf::RenderStates &states) {
-  ren_tex.draw(vertexBuffer, firstVertex, vertexCount, states);
+  flush_primitives();
+  if (active_layer == nullptr)
+    frame_changed = true;
+  count_draw(vertexCount, states.texture, states.shader);
+  render_target().draw(vertexBuffer, firstVertex, vertexCount, states);
 }
 
 void Data::draw_rect(const sf::Vector2f &pos, const sf::Vector2f &size,
@@ -1117,46 +2608,41 @@ void Data::draw_rect(const sf::Vector2f &pos, const sf::Vector2f &size,
                      float out_thic) {
   if (size.x <= 0.f || size.y <= 0.f)
     return;
+  sf::Vector2f origin{};
   switch (align) {
   case TopLeft: {
-    rect.setOrigin(0.f, 0.f);
+    origin = {0.f, 0.f};
   } break;
   case TopCenter: {
-    rect.setOrigin(size.x / 2.f, 0.f);
+    origin = {size.x / 2.f, 0.f};
   } break;
   case TopRight: {
-    rect.setOrigin(size.x, 0.f);
+    origin = {size.x, 0.f};
   } break;
   case CenterLeft: {
-    rect.setOrigin(0.f, size.y / 2.f);
+    origin = {0.f, size.y / 2.f};
   } break;
   case CenterCenter: {
-    rect.setOrigin(size.x / 2.f, size.y / 2.f);
+    origin = {size.x / 2.f, size.y / 2.f};
   } break;
   case CenterRight: {
-    rect.setOrigin(size.x, size.y / 2.f);
+    origin = {size.x, size.y / 2.f};
   } break;
   case BottomLeft: {
-    rect.setOrigin(0.f, size.y);
+    origin = {0.f, size.y};
   } break;
   case BottomCenter: {
-    rect.setOrigin(size.x / 2.f, size.y);
+    origin = {size.x / 2.f, size.y};
   } break;
   case BottomRight: {
-    rect.setOrigin(size.x, size.y);
+    origin = {size.x, size.y};
   } break;
   default: {
     UNREACHABLE();
   } break;
   };
 
-  rect.setPosition(pos + sf::Vector2f(out_thic, out_thic));
-  rect.setSize(size - sf::Vector2f(out_thic, out_thic));
-  rect.setFillColor(fill_col);
-  rect.setOutlineColor(out_col);
-  rect.setOutlineThickness(out_thic);
-
-  draw(rect);
+  batch::rect(primitives, pos - origin, size, fill_col, out_col, out_thic);
 }
 
 void Data::draw_rect(const sf::FloatRect &_rect, const Align &align,
@@ -1167,102 +2653,88 @@ void Data::draw_rect(const sf::FloatRect &_rect, const Align &align,
 
 void Data::draw_circle(const sf::Vector2f &pos, float radius,
                        sf::Color fill_col, sf::Color out_col, float out_thic) {
-  if (radius <= 0.f)
-    return;
-  circle.setPosition(pos);
-  circle.setOrigin({radius, radius});
-  circle.setRadius(radius);
-  circle.setFillColor(fill_col);
-  circle.setOutlineColor(out_col);
-  circle.setOutlineThickness(out_thic);
-
-  draw(circle);
+  batch::circle(primitives, pos, radius, fill_col, out_col, out_thic);
 }
 
 sf::Vector2f Data::draw_text(const sf::Vector2f &pos, const std::string &str,
                              const Align &align, int character_size,
                              sf::Color fill_col, sf::Color out_col,
                              float out_thic) {
-  text.setPosition(pos);
-  text.setString(str);
-  text.setCharacterSize(character_size - uint64_t(out_thic));
-  text.setFillColor(fill_col);
-  text.setOutlineColor(out_col);
-  text.setOutlineThickness(out_thic);
-
-  sf::FloatRect bound = text.getLocalBounds();
-  const sf::Vector2f &size = bound.getPosition() + bound.getSize();
+  // the outline changes the bounds, so only plain text goes through the cache
+  sf::Vector2f size;
+  if (out_thic == 0.f) {
+    size = get_text_size(str, character_size);
+  } else {
+    text.setString(str);
+    text.setCharacterSize(character_size - uint64_t(out_thic));
+    text.setOutlineThickness(out_thic);
+    sf::FloatRect bound = text.getLocalBounds();
+    size = bound.getPosition() + bound.getSize();
+  }
 
+  sf::Vector2f origin{};
   switch (align) {
   case TopLeft:
-    text.setOrigin({0.f, 0.f});
+    origin = {0.f, 0.f};
     break;
   case TopCenter:
-    text.setOrigin({size.x / 2.f, 0.f});
+    origin = {size.x / 2.f, 0.f};
     break;
   case TopRight:
-    text.setOrigin({size.x, 0.f});
+    origin = {size.x, 0.f};
     break;
   case CenterLeft:
-    text.setOrigin({0.f, size.y / 2.f});
+    origin = {0.f, size.y / 2.f};
     break;
   case CenterCenter:
-    text.setOrigin({size.x / 2.f, size.y / 2.f});
+    origin = {size.x / 2.f, size.y / 2.f};
     break;
   case CenterRight:
-    text.setOrigin({size.x, size.y / 2.f});
+    origin = {size.x, size.y / 2.f};
     break;
   case BottomLeft:
-    text.setOrigin({0.f, size.y});
+    origin = {0.f, size.y};
     break;
   case BottomCenter:
-    text.setOrigin({size.x / 2.f, size.y});
+    origin = {size.x / 2.f, size.y};
     break;
   case BottomRight:
-    text.setOrigin({size.x, size.y});
+    origin = {size.x, size.y};
     break;
   default:
     ASSERT_MSG(0, "Unreachable state reached in `draw_text`");
   }
 
+  // plain text is laid out into a reused vertex array; sf::Text would build
+  // an sf::String (a heap allocation for all but the shortest strings) on
+  // every call, so only outlined text still goes through it
+  if (out_thic == 0.f) {
+    const sf::Font &font = *text.getFont();
+    text_vertices.clear();
+    batch::text(text_vertices, font, str, unsigned(character_size),
+                pos - origin, fill_col);
+    sf::RenderStates states;
+    states.texture = &font.getTexture(unsigned(character_size));
+    draw(text_vertices, states);
+    return size;
+  }
+
+  text.setPosition(pos);
+  text.setOrigin(origin);
+  text.setFillColor(fill_col);
+  text.setOutlineColor(out_col);
   draw(text);
   return get_text_size(str, character_size);
 }
 
 void Data::draw_line(const sf::Vector2f &p1, const sf::Vector2f &p2,
                      sf::Color col, float out_thic) {
-  sf::Vertex q[4];
-  // 0------------1
-  // p1          p2
-  // 2------------3
-  sf::Vector2f n = v2f::normal(v2f::normalize(p2 - p1));
-  q[0].position = p1 + n * (out_thic / 2.f);
-  q[1].position = p2 + n * (out_thic / 2.f);
-  q[2].position = p1 - n * (out_thic / 2.f);
-  q[3].position = p2 - n * (out_thic / 2.f);
-  for (size_t i = 0; i < 4; ++i)
-    q[i].color = col;
-
-  draw(q, 4, sf::PrimitiveType::TriangleStrip);
+  batch::line(primitives, p1, p2, col, col, out_thic);
 }
 
 void Data::draw_line_ex(const sf::Vector2f &p1, const sf::Vector2f &p2,
                         sf::Color col1, sf::Color col2, float out_thic) {
-  sf::Vertex q[4];
-  // 0------------1
-  // p1          p2
-  // 2------------3
-  sf::Vector2f n = v2f::normal(v2f::normalize(p2 - p1));
-  q[0].position = p1 + n * (out_thic / 2.f);
-  q[2].position = p1 - n * (out_thic / 2.f);
-  q[0].color = col1;
-  q[2].color = col1;
-  q[1].position = p2 + n * (out_thic / 2.f);
-  q[3].position = p2 - n * (out_thic / 2.f);
-  q[1].color = col2;
-  q[3].color = col2;
-
-  draw(q, 4, sf::PrimitiveType::TriangleStrip);
+  batch::line(primitives, p1, p2, col1, col2, out_thic);
 }
 
 void Data::draw_arrow(const sf::Vector2f &p1, const sf::Vector2f &p2,
@@ -1279,16 +2751,8 @@ void Data::draw_arrow(const sf::Vector2f &p1, const sf::Vector2f &p2,
 
 void Data::draw_point(const sf::Vector2f &p, sf::Color col, float thic) {
   thic = std::fmaxf(0.1f, thic);
-  sf::Vertex q[4];
-  q[0].position = p + sf::Vector2f(-(thic / 2.f), -(thic / 2.f));
-  q[1].position = p + sf::Vector2f((thic / 2.f), -(thic / 2.f));
-  q[2].position = p + sf::Vector2f(-(thic / 2.f), (thic / 2.f));
-  q[3].position = p + sf::Vector2f((thic / 2.f), (thic / 2.f));
-  for (size_t i = 0; i < 4; ++i) {
-    q[i].color = col;
-  }
-
-  ren_tex.draw(q, 4, sf::PrimitiveType::TriangleStrip);
+  const sf::Vector2f half{thic / 2.f, thic / 2.f};
+  batch::quad(primitives, p - half, p + half, col);
 }
 
 void Data::update_mouse_event(const sf::Event &e) {
@@ -1408,34 +2872,163 @@ sf::Vector2f Data::ss_f() const {
 sf::Vector2i Data::ss_i() const { return sf::Vector2i(width, height); }
 
 sf::Vector2f Data::scr_to_wrld(const sf::Vector2f &p) {
-  sf::Vector2f res = ren_tex.mapPixelToCoords(
+  // both targets are width x height in Direct mode as well, since scale is 1
+  sf::Vector2f res = render_target().mapPixelToCoords(
       sf::Vector2i(int(std::floorf(p.x)), int(std::floorf(p.y))), _camera_view);
   return res;
 }
 
 sf::Vector2f Data::wrld_to_scr(const sf::Vector2f &p) {
   sf::Vector2i res_i =
-      ren_tex.mapCoordsToPixel(sf::Vector2f(std::floorf(p.x), std::floorf(p.y)),
-                               ren_tex.getDefaultView());
+      render_target().mapCoordsToPixel(
+          sf::Vector2f(std::floorf(p.x), std::floorf(p.y)),
+          render_target().getDefaultView());
   sf::Vector2f res = sf::Vector2f(res_i);
   return res;
 }
 
-void Data::handle_close(sf::Event &e) {
-  if (e.type == sf::Event::Closed) {
-    win.close();
-  }
+void Data::set_on_demand(bool enabled) {
+  on_demand = enabled;
+  redraw_requested = true;
 }
 
-float Data::calc_delta() {
-  delta = clock.restart().asSeconds();
-  return delta;
+void Data::request_redraw() { redraw_requested = true; }
+
+void Data::wait_for_frame(float timeout) {
+  if (!on_demand || redraw_requested || !queued_events.empty())
+    return;
+
+  sf::Event e;
+  if (timeout < 0.f) {
+    if (win.waitEvent(e)) {
+      note_input(e);
+      queued_events.push_back(e);
+    }
+    return;
+  }
+
+  // sf::Window::waitEvent() can't time out, so wait on the thread's message
+  // queue directly; a message that doesn't become an sf::Event (or a spurious
+  // wake-up) just waits again for the rest of the timeout
+  const sf::Time deadline = pacing_clock.getElapsedTime() + sf::seconds(timeout);
+  while (win.isOpen()) {
+    if (win.pollEvent(e)) {
+      note_input(e);
+      queued_events.push_back(e);
+      break;
+    }
+    const sf::Time left = deadline - pacing_clock.getElapsedTime();
+    if (left <= sf::Time::Zero)
+      break;
+#ifdef _WIN32
+    const DWORD ms = DWORD((left.asMicroseconds() + 999) / 1000);
+    MsgWaitForMultipleObjectsEx(0, nullptr, ms, QS_ALLINPUT,
+                                MWMO_INPUTAVAILABLE);
+#else
+    sf::sleep(std::min(left, sf::milliseconds(1)));
+#endif
+  }
+}
+
+bool Data::poll_event(sf::Event &e) {
+  if (!queued_events.empty()) {
+    e = queued_events.front();
+    queued_events.pop_front();
+    frame_changed = true;
+    return true;
+  }
+  if (!win.pollEvent(e))
+    return false;
+  note_input(e);
+  frame_changed = true;
+  return true;
+}
+
+void Data::note_input(const sf::Event &e) {
+  if (e.type == sf::Event::TextEntered)
+    pending_inputs.push_back(pacing_clock.getElapsedTime());
+}
+
+void Data::set_frame_pacing(Frame_pacing pacing, float limit) {
+  frame_pacing = pacing;
+  fps_limit = limit;
+  win.setVerticalSyncEnabled(pacing != Frame_pacing::Uncapped);
+}
+
+// sleeps most of the way, then yields for the last millisecond since the
+// os sleep is only about 1ms accurate
+static void sleep_until(const sf::Clock &clock, sf::Time target) {
+  const sf::Time slack = sf::milliseconds(1);
+  sf::Time now = clock.getElapsedTime();
+  if (target - now > slack)
+    sf::sleep(target - now - slack);
+  while (clock.getElapsedTime() < target)
+    std::this_thread::yield();
+}
+
+void Data::pace_frame() {
+  switch (frame_pacing) {
+  case Frame_pacing::Vsync:
+    break;
+  case Frame_pacing::Low_latency: {
+    // wake up early enough to do a frame's worth of work, plus a margin for
+    // the driver and the scheduler
+    const float margin = 0.0015f;
+    const sf::Time target =
+        last_present +
+        sf::seconds(std::max(0.f, present_interval - frame_work - margin));
+    sleep_until(pacing_clock, target);
+  } break;
+  case Frame_pacing::Uncapped: {
+    if (fps_limit > 0.f)
+      sleep_until(pacing_clock, last_present + sf::seconds(1.f / fps_limit));
+  } break;
+  default:
+    UNREACHABLE();
+  }
+  frame_start = pacing_clock.getElapsedTime();
+}
+
+void Data::handle_close(sf::Event &e) {
+  if (e.type == sf::Event::Closed) {
+    win.close();
+  }
+}
+
+float Data::calc_delta() {
+  delta = clock.restart().asSeconds();
+#ifdef SH_PROFILER
+  Profiler::frame(delta);
+#endif
+  return delta;
 }
 
 void Data::update_title() {
   fps = int(1.f / delta);
-  win.setTitle(std::format("{} | {:.2f}s | {}fps", title, delta, fps));
   _mouse_scroll = 0.f;
+  title_updated = false;
+
+  // only refresh a couple of times a second and only when the text actually
+  // changed
+  if (title_clock.getElapsedTime().asSeconds() < 0.5f && title_text[0] != 0)
+    return;
+  title_clock.restart();
+
+  char buf[sizeof(title_text)];
+  const auto res = std::format_to_n(buf, sizeof(buf) - 1,
+                                    "{} | {:.2f}s | {}fps", title, delta, fps);
+  *res.out = 0;
+  if (std::strcmp(buf, title_text) == 0)
+    return;
+  std::memcpy(title_text, buf, sizeof(buf));
+#ifdef _WIN32
+  // win.setTitle() builds an sf::String and then a std::wstring; like
+  // sf::String(const char *), this takes the title in the ANSI code page
+  SetWindowTextA(win.getSystemHandle(), title_text);
+#else
+  win.setTitle(title_text);
+#endif
+  title_updated = true;
 }
 
 int Data::default_char_size() const {
@@ -1541,129 +3134,471 @@ void Data::camera_follow(const sf::Vector2f &pos, float rate) {
 
 float &Data::camera_zoom() { return _camera_zoom; }
 
-void Data::camera_view() { ren_tex.setView(_camera_view); }
+Layer &Data::create_layer() {
+  layers.push_back(std::make_unique<Layer>());
+  Layer &layer = *layers.back();
+  if (!layer.tex.create(width, height)) {
+    ERR("Could not create layer render texture!\n");
+  }
+  return layer;
+}
 
-void Data::default_view() { ren_tex.setView(ren_tex.getDefaultView()); }
+bool Data::begin_layer(Layer &layer) {
+  ASSERT(active_layer == nullptr);
+  if (!layer.dirty && layer.next_region == layer.region_count)
+    return false;
+  flush_primitives();
+  active_layer = &layer;
+  frame_stats.rt_passes++;
+  frame_stats.view_switches++;
+  layer.tex.setView(layer.tex.getDefaultView());
+
+  frame_changed = true;
+  if (layer.dirty) {
+    // covers the pending regions too
+    layer.region_count = layer.next_region = 0;
+    layer.tex.clear(sf::Color::Transparent);
+    return true;
+  }
 
-sf::Vector2f Data::get_text_size(const std::string &text, size_t char_size,
-                                 const sf::Vector2f &padding) {
-  //
-  sf::Text t;
-  t.setFont(res_man.get_font(DEFAULT_FONT_NAME));
-  t.setString(text);
-  t.setCharacterSize(static_cast<unsigned int>(char_size));
+  // erase the region, then clip everything until end_layer() to it
+  layer_clip = &layer.regions[layer.next_region++];
+  const sf::FloatRect &r = *layer_clip;
+  const sf::Vertex quad[4] = {
+      {{r.left, r.top}, sf::Color::Transparent},
+      {{r.left + r.width, r.top}, sf::Color::Transparent},
+      {{r.left, r.top + r.height}, sf::Color::Transparent},
+      {{r.left + r.width, r.top + r.height}, sf::Color::Transparent}};
+  sf::RenderStates states;
+  states.blendMode = sf::BlendNone;
+  count_draw(4, nullptr, nullptr);
+  layer.tex.draw(quad, 4, sf::TriangleStrip, states);
+
+  frame_stats.view_switches++;
+  layer.tex.setView(clip_view(layer.tex.getDefaultView()));
+  return true;
+}
+
+void Data::end_layer() {
+  ASSERT(active_layer != nullptr);
+  flush_primitives();
+  Layer &layer = *active_layer;
+  active_layer = nullptr;
+  layer_clip = nullptr;
 
-  return t.getLocalBounds().getSize() + t.getLocalBounds().getPosition() +
-         padding;
+  // the caller's loop comes back for the remaining regions
+  if (layer.next_region < layer.region_count)
+    return;
+  layer.tex.display();
+  layer.dirty = false;
+  layer.region_count = layer.next_region = 0;
 }
 
-// resource_manager --------------------------------------------------
-bool Resource_manager::load_all_textures() {
-  std::vector<Data_chunk> chunks = list_of_chunks_in_data();
+void Data::invalidate(Layer &layer) { layer.dirty = true; }
 
-  if (chunks.empty()) {
-    ERR("No chunk(s) found in `data.dat`\n");
-    return false;
-  }
+static sf::FloatRect rect_union(const sf::FloatRect &a, const sf::FloatRect &b) {
+  const float left = std::min(a.left, b.left);
+  const float top = std::min(a.top, b.top);
+  return {left, top, std::max(a.left + a.width, b.left + b.width) - left,
+          std::max(a.top + a.height, b.top + b.height) - top};
+}
 
-  // loading texture data
-  for (auto &ch : chunks) {
-    if (ch.type == Data_type::Texture) {
-      texture_chunks.push_back(ch);
-    } else {
-      ch.free();
-    }
-  }
+void Data::invalidate(Layer &layer, const sf::FloatRect &rect,
+                      const sf::View &view) {
+  if (layer.dirty)
+    return;
 
-  // loading texture
-  for (auto &ch : texture_chunks) {
-    sf::Texture tex;
-    if (!tex.loadFromMemory(ch.data, ch.data_size)) {
-      ERR("Could not load texture data `{}`\n", ch.name);
-      return false;
+  // whole pixels, so the clipped viewport lines up, plus one for outlines
+  const sf::Vector2i a =
+      layer.tex.mapCoordsToPixel({rect.left, rect.top}, view);
+  const sf::Vector2i b = layer.tex.mapCoordsToPixel(
+      {rect.left + rect.width, rect.top + rect.height}, view);
+  sf::FloatRect r{float(std::min(a.x, b.x) - 1), float(std::min(a.y, b.y) - 1),
+                  float(std::abs(b.x - a.x) + 2),
+                  float(std::abs(b.y - a.y) + 2)};
+  const sf::FloatRect bounds{{0.f, 0.f}, sf::Vector2f(layer.tex.getSize())};
+  if (!r.intersects(bounds, r))
+    return;
+
+  for (size_t i = layer.next_region; i < layer.region_count; ++i) {
+    if (layer.regions[i].intersects(r)) {
+      layer.regions[i] = rect_union(layer.regions[i], r);
+      return;
     }
-    textures[ch.name] = tex;
   }
+  if (layer.region_count == Layer::MAX_REGIONS) {
+    layer.regions[Layer::MAX_REGIONS - 1] =
+        rect_union(layer.regions[Layer::MAX_REGIONS - 1], r);
+    return;
+  }
+  layer.regions[layer.region_count++] = r;
+}
 
-  // d_info(std::format("Loaded {} textures", texture_chunks.size()));
-  return true;
+void Data::invalidate(Layer &layer, const sf::FloatRect &rect) {
+  invalidate(layer, rect, layer.tex.getDefaultView());
 }
 
-bool Resource_manager::load_all_fonts() {
-  std::vector<Data_chunk> chunks = list_of_chunks_in_data();
+bool Data::in_layer_region(const sf::FloatRect &rect) {
+  if (active_layer == nullptr || layer_clip == nullptr)
+    return true;
+  // the clipped view maps to the same layer pixels as the full one
+  const sf::View &view = active_layer->tex.getView();
+  const sf::Vector2i a =
+      active_layer->tex.mapCoordsToPixel({rect.left, rect.top}, view);
+  const sf::Vector2i b = active_layer->tex.mapCoordsToPixel(
+      {rect.left + rect.width, rect.top + rect.height}, view);
+  const sf::FloatRect r{float(std::min(a.x, b.x) - 1),
+                        float(std::min(a.y, b.y) - 1),
+                        float(std::abs(b.x - a.x) + 2),
+                        float(std::abs(b.y - a.y) + 2)};
+  return r.intersects(*layer_clip);
+}
 
-  if (chunks.empty()) {
-    ERR("No chunk(s) found in `data.dat`\n");
-    return false;
-  }
+sf::View Data::clip_view(const sf::View &view) {
+  if (active_layer == nullptr || layer_clip == nullptr)
+    return view;
+
+  // same mapping from world to layer pixels (for a full-target viewport),
+  // restricted to the region
+  const sf::Vector2f size(active_layer->tex.getSize());
+  const sf::FloatRect &r = *layer_clip;
+  const sf::Vector2f c{r.left + r.width / 2.f, r.top + r.height / 2.f};
+  sf::View clipped = view;
+  clipped.setCenter(view.getInverseTransform().transformPoint(
+      2.f * c.x / size.x - 1.f, 1.f - 2.f * c.y / size.y));
+  clipped.setSize(view.getSize().x * r.width / size.x,
+                  view.getSize().y * r.height / size.y);
+  clipped.setViewport({r.left / size.x, r.top / size.y, r.width / size.x,
+                       r.height / size.y});
+  return clipped;
+}
 
-  // loading font data
-  for (auto &ch : chunks) {
-    if (ch.type == Data_type::Font) {
-      font_chunks.push_back(ch);
-    } else {
-      ch.free();
-    }
-  }
+void Data::draw_layer(const Layer &layer) {
+  flush_primitives();
+  sf::RenderTarget &target = render_target();
+  const sf::View view = target.getView();
+  target.setView(clip_view(target.getDefaultView()));
+
+  // layers were drawn with alpha blending onto transparent black, so their
+  // colors are already premultiplied
+  sf::RenderStates states;
+  states.blendMode =
+      sf::BlendMode(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha);
+  const sf::Sprite sprite(layer.tex.getTexture());
+  count_draw(sprite, states);
+  target.draw(sprite, states);
+
+  target.setView(view);
+  frame_stats.view_switches += 2;
+}
 
-  // loading font
-  for (auto &ch : font_chunks) {
-    sf::Font font;
-    if (!font.loadFromMemory(ch.data, ch.data_size)) {
-      ERR("Could not load font data `{}`\n", ch.name);
-      return false;
+void Data::camera_view() {
+  flush_primitives();
+  frame_stats.view_switches++;
+  render_target().setView(clip_view(_camera_view));
+}
+
+void Data::default_view() {
+  flush_primitives();
+  frame_stats.view_switches++;
+  render_target().setView(clip_view(render_target().getDefaultView()));
+}
+
+sf::Vector2f Data::get_text_size(const std::string &text, size_t char_size,
+                                 const sf::Vector2f &padding) {
+  const sf::Font *font = &res_man.get_font(default_font_id);
+  sf::Vector2f size;
+  if (text_sizes.find(text, font, uint32_t(char_size), size))
+    return size + padding;
+
+  size = batch::text_size(*font, text, static_cast<unsigned int>(char_size));
+  text_sizes.insert(text, font, uint32_t(char_size), size);
+
+  return size + padding;
+}
+
+size_t Data::prewarm_glyphs(const std::string &chars,
+                           const std::vector<unsigned int> &char_sizes) {
+  sf::Font &font = res_man.get_font(default_font_id);
+
+  std::vector<sf::Uint32> codepoints;
+  for (sf::Uint32 c = 32; c < 127; ++c)
+    codepoints.push_back(c);
+  const sf::String decoded = sf::String::fromUtf8(chars.begin(), chars.end());
+  for (sf::Uint32 c : decoded) {
+    if (c >= 32 && c < 127)
+      continue;
+    if (c == '\n' || c == '\r' || c == '\t')
+      continue;
+    codepoints.push_back(c);
+  }
+  std::sort(codepoints.begin(), codepoints.end());
+  codepoints.erase(std::unique(codepoints.begin(), codepoints.end()),
+                   codepoints.end());
+
+  size_t warmed = 0;
+  for (unsigned int size : char_sizes) {
+    const sf::Vector2u before = font.getTexture(size).getSize();
+    for (sf::Uint32 c : codepoints) {
+      font.getGlyph(c, size, false);
+      ++warmed;
     }
-    fonts[ch.name] = font;
+    const sf::Vector2u after = font.getTexture(size).getSize();
+    print("Prewarmed {} glyphs at size {}: atlas {}x{} -> {}x{}\n",
+          codepoints.size(), size, before.x, before.y, after.x, after.y);
   }
+  return warmed;
+}
 
-  // d_info(std::format("Loaded {} Fonts", font_chunks.size()));
-  return true;
+// resource_manager --------------------------------------------------
+bool Resource_manager::load_all_textures() {
+  return load_all(Data_type::Texture);
 }
 
-sf::Font &Resource_manager::load_font(const std::string &filename) {
-  std::vector<Data_chunk> chunks = list_of_chunks_in_data();
+bool Resource_manager::load_all_fonts() { return load_all(Data_type::Font); }
 
-  if (chunks.empty()) {
-    ERR("No chunk(s) found in `data.dat`\n");
-    exit(1);
-  }
+bool Resource_manager::load_all(Data_type type) {
+  ASSERT(type == Data_type::Texture || type == Data_type::Font);
+  if (!indexed)
+    index_data();
 
-  // loading font data
-  for (auto &ch : chunks) {
-    if (ch.type == Data_type::Font && ch.name == filename) {
-      font_chunks.push_back(ch);
-    } else {
-      ch.free();
+  std::vector<std::shared_ptr<Async_load>> loads;
+  for (auto &[name, loc] : chunk_index) {
+    if (loc.type != type || pending.contains(name) ||
+        failed_loads.contains(name) ||
+        (type == Data_type::Texture && textures.contains(name)) ||
+        (type == Data_type::Font && fonts.contains(name))) {
+      continue;
     }
+    loads.push_back(prepare_load(type, name));
   }
+  // in file order, so the workers read the pack front to back
+  std::sort(loads.begin(), loads.end(), [](auto &a, auto &b) {
+    return a->chunk.offset < b->chunk.offset;
+  });
 
-  if (font_chunks.empty()) { // couldnt find wanted font
+  // decoding on the pool
+  sf::Clock clock;
+  pool.parallel_for(loads.size(), [&](size_t i) {
+    if (!loads[i]->done)
+      loads[i]->decode();
+  });
+  const float decode_time = clock.restart().asSeconds();
+
+  // uploading (textures) on this thread
+  bool ok = true;
+  for (auto &load : loads) {
+    ok &= finish_load(*load);
+  }
+
+  print("Loaded {} {}: {:.2f}ms decoding on {} threads, {:.2f}ms "
+        "uploading\n",
+        loads.size(), type == Data_type::Texture ? "textures" : "fonts",
+        decode_time * 1000.f, pool.workers.size(),
+        clock.getElapsedTime().asSeconds() * 1000.f);
+  return ok;
+}
+
+sf::Font &Resource_manager::load_font(const std::string &filename) {
+  Data_chunk ch{};
+  if (!read_chunk(ch, filename, Data_type::Font)) { // couldnt find wanted font
     ERR("Could not find font `{}`\n", filename);
   }
 
   // loading font
   sf::Font font;
-  auto &ch = font_chunks.back();
   if (!font.loadFromMemory(ch.data, ch.data_size)) {
     ERR("Could not load font data `{}`\n", ch.name);
     exit(1);
   }
   fonts[ch.name] = font;
+  font_chunks.push_back(std::move(ch));
 
-  // d_info(std::format("Loaded font `{}`", font_chunks.back().name));
-  return fonts[ch.name];
+  // d_info(std::format("Loaded font `{}`", filename));
+  return fonts[filename];
 }
 
 sf::Texture &Resource_manager::get_texture(const std::string &filename) {
+  // a texture requested through a handle is adopted rather than read twice
+  finish_pending(filename);
+
   // return the texture if it already exists
-  if (!textures.contains(filename)) {
+  if (textures.contains(filename)) {
+    return textures.at(filename);
+  }
+
+  Data_chunk ch{};
+  if (!read_chunk(ch, filename, Data_type::Texture)) {
     ERR("the texture `{} doesn't exist!`\n", filename);
   }
+  sf::Texture &tex = textures[filename];
+  if (!tex.loadFromMemory(ch.data, ch.data_size)) {
+    ERR("Could not load texture data `{}`\n", filename);
+  }
+  return tex;
+}
+
+Texture_handle Resource_manager::texture(const std::string &filename) {
+  return Texture_handle{this, filename};
+}
+
+Font_handle Resource_manager::font(const std::string &filename) {
+  return Font_handle{this, filename};
+}
+
+void Resource_manager::Async_load::decode() {
+  std::ifstream ifs;
+  ifs.open("data.dat", std::ios::binary);
+  ifs.seekg(chunk.offset, std::ios::beg);
+  sf::Clock clock;
+  if (ifs.read(chunk.data, chunk.data_size) && chunk.verify()) {
+    if (type == Data_type::Texture) {
+      ok = image.loadFromMemory(chunk.data, chunk.data_size);
+    } else {
+      ok = font.loadFromMemory(chunk.data, chunk.data_size);
+    }
+  }
+  decode_ms = clock.getElapsedTime().asSeconds() * 1000.f;
+  done = true;
+  done.notify_all();
+}
+
+std::shared_ptr<Resource_manager::Async_load>
+Resource_manager::prepare_load(Data_type type, const std::string &filename) {
+  auto load = std::make_shared<Async_load>();
+  load->type = type;
+  load->name = filename;
+  if (!find_chunk(load->chunk, filename, type)) {
+    // reported when the load is finished
+    load->done = true;
+    return load;
+  }
+  load->chunk.allocate(load->chunk.data_size);
+  return load;
+}
 
-  return textures.at(filename);
+void Resource_manager::request(Data_type type, const std::string &filename) {
+  ASSERT(type == Data_type::Texture || type == Data_type::Font);
+  if (pending.contains(filename) || failed_loads.contains(filename) ||
+      (type == Data_type::Texture && textures.contains(filename)) ||
+      (type == Data_type::Font && fonts.contains(filename))) {
+    return;
+  }
+
+  auto load = prepare_load(type, filename);
+  pending[filename] = load;
+  if (!load->done) {
+    pool.push([load]() { load->decode(); });
+  }
+}
+
+bool Resource_manager::finish_load(Async_load &load) {
+  if (load.ok && load.type == Data_type::Texture) {
+    sf::Clock upload_clock;
+    load.ok = textures[load.name].loadFromImage(load.image);
+    if (load.ok) {
+      print("Texture `{}`: decoded in {:.2f}ms, uploaded in {:.2f}ms\n",
+            load.name, load.decode_ms,
+            upload_clock.getElapsedTime().asSeconds() * 1000.f);
+    } else {
+      textures.erase(load.name);
+    }
+  } else if (load.ok) {
+    fonts[load.name] = load.font;
+    // sf::Font reads its data lazily
+    font_chunks.push_back(std::move(load.chunk));
+    print("Font `{}`: parsed in {:.2f}ms\n", load.name, load.decode_ms);
+  }
+
+  if (!load.ok) {
+    WARNING(FMT("Could not load `{}`, keeping the placeholder\n", load.name));
+    failed_loads.insert(load.name);
+  }
+  return load.ok;
+}
+
+void Resource_manager::finish_pending(const std::string &filename) {
+  auto it = pending.find(filename);
+  if (it == pending.end())
+    return;
+
+  std::shared_ptr<Async_load> load = std::move(it->second);
+  pending.erase(it);
+  load->done.wait(false);
+  finish_load(*load);
+}
+
+bool Resource_manager::update() {
+  bool ok = true;
+  for (auto it = pending.begin(); it != pending.end();) {
+    auto &load = it->second;
+    if (!load->done) {
+      ++it;
+      continue;
+    }
+
+    ok &= finish_load(*load);
+    it = pending.erase(it);
+  }
+  return ok;
+}
+
+sf::Texture &Resource_manager::get_placeholder_texture() {
+  if (placeholder_texture.getSize().x == 0) {
+    // magenta/black checker
+    sf::Image image;
+    image.create(2, 2, sf::Color::Magenta);
+    image.setPixel(1, 0, sf::Color::Black);
+    image.setPixel(0, 1, sf::Color::Black);
+    placeholder_texture.loadFromImage(image);
+  }
+  return placeholder_texture;
+}
+
+sf::Font &Resource_manager::get_placeholder_font() {
+  return get_font(DEFAULT_FONT_NAME);
+}
+
+// asset handles --------------------------------------------------
+sf::Texture &Texture_handle::get() {
+  if (ready()) {
+    return *texture;
+  }
+  res_man->request(Data_type::Texture, name);
+  return res_man->get_placeholder_texture();
+}
+
+bool Texture_handle::ready() {
+  if (texture == nullptr) {
+    auto it = res_man->textures.find(name);
+    if (it != res_man->textures.end()) {
+      texture = &it->second;
+    }
+  }
+  return texture != nullptr;
+}
+
+sf::Font &Font_handle::get() {
+  if (ready()) {
+    return *font;
+  }
+  res_man->request(Data_type::Font, name);
+  return res_man->get_placeholder_font();
+}
+
+bool Font_handle::ready() {
+  if (font == nullptr) {
+    auto it = res_man->fonts.find(name);
+    if (it != res_man->fonts.end()) {
+      font = &it->second;
+    }
+  }
+  return font != nullptr;
 }
 
 sf::Font &Resource_manager::get_font(const std::string &filename) {
+  finish_pending(filename);
+
   // return the font if it already exists
   if (!fonts.contains(filename)) {
     ERR("the font `{} doesn't exist!`\n", filename);
@@ -1672,8 +3607,288 @@ sf::Font &Resource_manager::get_font(const std::string &filename) {
   return fonts.at(filename);
 }
 
+void Resource_manager::index_data() {
+  indexed = true;
+  chunk_index.clear();
+
+  std::ifstream ifs;
+  size_t total_bytes = 0;
+  if (!open_data(ifs, total_bytes)) {
+    return;
+  }
+
+  std::vector<std::pair<std::string, std::string>> aliases; // name, target
+  while (size_t(ifs.tellg()) < total_bytes) {
+    Data_chunk chunk{};
+    if (!read_chunk_header(ifs, chunk, total_bytes)) {
+      return;
+    }
+    id(chunk.name);
+
+    if (chunk.type == Data_type::Alias) {
+      std::string target(chunk.data_size, '\0');
+      ifs.read(target.data(), chunk.data_size);
+      aliases.emplace_back(chunk.name, std::move(target));
+      continue;
+    }
+    ifs.seekg(chunk.data_size, std::ios::cur);
+    chunk_index.try_emplace(chunk.name, Chunk_location{chunk.type, chunk.offset,
+                                                       chunk.data_size,
+                                                       chunk.crc});
+  }
+
+  // like `list_of_chunks_in_data`, an alias only resolves to a real chunk
+  std::vector<std::pair<std::string, Chunk_location>> resolved;
+  for (auto &[name, target] : aliases) {
+    auto it = chunk_index.find(target);
+    if (it == chunk_index.end()) {
+      WARNING(FMT("Alias `{}` points to missing chunk `{}`\n", name, target));
+      continue;
+    }
+    resolved.emplace_back(name, it->second);
+  }
+  for (auto &[name, loc] : resolved) {
+    chunk_index.try_emplace(name, loc);
+  }
+}
+
+bool Resource_manager::find_chunk(Data_chunk &chunk, const std::string &name,
+                                  Data_type type) {
+  if (!indexed)
+    index_data();
+
+  auto it = chunk_index.find(name);
+  if (it == chunk_index.end() ||
+      (type != Data_type::None && it->second.type != type)) {
+    return false;
+  }
+
+  chunk.type = it->second.type;
+  chunk.name = name;
+  chunk.name_size = name.size();
+  chunk.offset = it->second.offset;
+  chunk.data_size = it->second.data_size;
+  chunk.crc = it->second.crc;
+  chunk.verified = false;
+  return true;
+}
+
+bool Resource_manager::read_chunk(Data_chunk &chunk, const std::string &name,
+                                  Data_type type) {
+  if (!find_chunk(chunk, name, type)) {
+    WARNING(FMT("Could not find `{}` in `data.dat`\n", name));
+    return false;
+  }
+
+  std::ifstream ifs;
+  ifs.open("data.dat", std::ios::binary);
+  chunk.allocate(chunk.data_size);
+  ifs.seekg(chunk.offset, std::ios::beg);
+  if (!ifs.read(chunk.data, chunk.data_size)) {
+    WARNING(FMT("Could not read `{}` from `data.dat`\n", name));
+    return false;
+  }
+  if (!chunk.verify()) {
+    WARNING(FMT("`{}` failed its checksum, `data.dat` is corrupt\n", name));
+    return false;
+  }
+  return true;
+}
+
+Asset_id Resource_manager::id(const std::string &filename) {
+  uint64_t hash = hash_fnv1a(filename.c_str(), filename.size());
+  auto it = ids.find(hash);
+  if (it != ids.end()) {
+    ASSERT_MSG(id_names[it->second.index] == filename,
+               "asset name hash collision");
+    return it->second;
+  }
+
+  Asset_id new_id{uint32_t(id_names.size())};
+  ids[hash] = new_id;
+  id_names.push_back(filename);
+  texture_table.push_back(nullptr);
+  font_table.push_back(nullptr);
+  return new_id;
+}
+
+Asset_id Resource_manager::id(uint64_t name_hash) {
+  auto it = ids.find(name_hash);
+  if (it == ids.end()) {
+    ERR("No asset with name hash {:#x} has been interned\n", name_hash);
+  }
+  return it->second;
+}
+
+sf::Texture &Resource_manager::get_texture(Asset_id id) {
+  ASSERT(id.index < texture_table.size());
+  sf::Texture *tex = texture_table[id.index];
+  if (tex == nullptr) {
+    tex = texture_table[id.index] = &get_texture(id_names[id.index]);
+  }
+  return *tex;
+}
+
+sf::Font &Resource_manager::get_font(Asset_id id) {
+  ASSERT(id.index < font_table.size());
+  sf::Font *font = font_table[id.index];
+  if (font == nullptr) {
+    font = font_table[id.index] = &get_font(id_names[id.index]);
+  }
+  return *font;
+}
+
+static sf::Shader::Type shader_type_from_extension(const std::string &name) {
+  std::string ext = fs::path(name).extension().string();
+  ::str::tolower(ext);
+  if (ext == ".vert")
+    return sf::Shader::Vertex;
+  if (ext == ".geom")
+    return sf::Shader::Geometry;
+  return sf::Shader::Fragment;
+}
+
+static sf::Shader *compile_shader(Resource_manager &res_man, Data_chunk &ch) {
+  if (!ch.verify()) {
+    WARNING(FMT("Shader `{}` failed its checksum, `data.dat` is corrupt\n",
+                ch.name));
+    return nullptr;
+  }
+
+  sf::Shader::Type type = shader_type_from_extension(ch.name);
+  auto key = std::make_pair(hash_fnv1a(ch.data, ch.data_size), type);
+
+  auto it = res_man.shader_programs.find(key);
+  if (it != res_man.shader_programs.end()) {
+    print("Shader `{}`: shared compiled program\n", ch.name);
+  } else {
+    // only cache programs that compiled, so a failure isn't shared
+    sf::Clock clock;
+    auto program = std::make_unique<sf::Shader>();
+    if (!program->loadFromMemory(std::string(ch.data, ch.data_size), type)) {
+      WARNING(FMT("Could not compile shader `{}`\n", ch.name));
+      return nullptr;
+    }
+    print("Shader `{}`: compiled in {:.2f}ms\n", ch.name,
+          clock.getElapsedTime().asSeconds() * 1000.f);
+    it = res_man.shader_programs.emplace(key, std::move(program)).first;
+  }
+
+  res_man.shaders[ch.name] = it->second.get();
+  return it->second.get();
+}
+
+bool Resource_manager::load_all_shaders() {
+  if (!sf::Shader::isAvailable()) {
+    WARNING("Shaders are not available on this system\n");
+    return true;
+  }
+
+  if (!indexed)
+    index_data();
+
+  // only the shader payloads are read, each straight from its offset
+  bool ok = true;
+  for (auto &[name, loc] : chunk_index) {
+    if (loc.type != Data_type::Shader || shaders.contains(name))
+      continue;
+    Data_chunk ch{};
+    ok &= read_chunk(ch, name, Data_type::Shader) &&
+          compile_shader(*this, ch) != nullptr;
+  }
+  return ok;
+}
+
+sf::Shader &Resource_manager::load_shader(const std::string &filename) {
+  if (shaders.contains(filename)) {
+    return *shaders.at(filename);
+  }
+
+  Data_chunk ch{};
+  if (!read_chunk(ch, filename, Data_type::Shader)) {
+    exit(1);
+  }
+  sf::Shader *shader = compile_shader(*this, ch);
+  if (shader == nullptr) {
+    exit(1);
+  }
+  return *shader;
+}
+
+sf::Shader &Resource_manager::get_shader(const std::string &filename) {
+  if (!shaders.contains(filename)) {
+    ERR("the shader `{} doesn't exist!`\n", filename);
+  }
+
+  return *shaders.at(filename);
+}
+
+sf::SoundBuffer &Resource_manager::load_sound(const std::string &filename) {
+  if (sounds.contains(filename)) {
+    return sounds.at(filename);
+  }
+
+  // decode directly from the data file, no intermediate copy of the chunk
+  Data_stream stream;
+  if (!stream.open(filename, Data_type::Sound)) {
+    exit(1);
+  }
+  if (!stream.verify()) {
+    ERR("Sound `{}` failed its checksum, `data.dat` is corrupt\n", filename);
+  }
+
+  sf::SoundBuffer &buffer = sounds[filename];
+  if (!buffer.loadFromStream(stream)) {
+    ERR("Could not load sound data `{}`\n", filename);
+  }
+  return buffer;
+}
+
+sf::Music &Resource_manager::open_music(const std::string &filename) {
+  if (musics.contains(filename)) {
+    return musics.at(filename)->music;
+  }
+
+  // the checksum is not verified here, it would mean reading the whole track
+  // up front; use `verify_data` to check the pack
+  auto m = std::make_unique<Music>();
+  if (!m->stream.open(filename, Data_type::Sound)) {
+    exit(1);
+  }
+  if (!m->music.openFromStream(m->stream)) {
+    ERR("Could not open music `{}`\n", filename);
+  }
+
+  sf::Music &music = m->music;
+  musics[filename] = std::move(m);
+  return music;
+}
+
+sf::SoundBuffer &Resource_manager::get_sound(const std::string &filename) {
+  if (!sounds.contains(filename)) {
+    ERR("the sound `{} doesn't exist!`\n", filename);
+  }
+
+  return sounds.at(filename);
+}
+
+sf::Music &Resource_manager::get_music(const std::string &filename) {
+  if (!musics.contains(filename)) {
+    ERR("the music `{} doesn't exist!`\n", filename);
+  }
+
+  return musics.at(filename)->music;
+}
+
 // UI --------------------------------------------------
-UI::UI(Data &d) : active_id(-1) { d_ptr = &d; }
+UI::UI(Data &d) : active_id(-1) {
+  d_ptr = &d;
+  batches.resize(4);
+  for (auto &b : batches) {
+    b.vertices.resize(1024);
+    b.vertices.clear();
+  }
+}
 
 UI::Layout *UI::top_layout() {
   if (layouts.empty())
@@ -1708,20 +3923,27 @@ void UI::begin(const sf::Vector2f &pos, Layout::Kind kind) {
   l.pos = pos;
   l.kind = kind;
   layouts.push_back(l);
-}
 
-bool UI::btn(const std::string &str, const Align &align, size_t char_size,
-             sf::Color col) {
-  ///
-  Layout *l = top_layout();
-  ASSERT(l != nullptr);
-  int id = current_id++;
+  // a new frame: forget the panels the last one didn't use, and geometry that
+  // was never drawn
+  if (frame != d_ptr->frame_index) {
+    frame = d_ptr->frame_index;
+    panels.resize(panels_begun);
+    panels_begun = 0;
+    batch_count = 0;
+  }
 
-  sf::Vector2f padding{10.f, 10.f};
-  sf::Vector2f pos = l->available_pos();
-  sf::Vector2f size = d_ptr->get_text_size(str, char_size, padding);
-  sf::Vector2f size_to_push{size + padding};
+  current_panel = panels_begun++;
+  if (current_panel == panels.size())
+    panels.emplace_back();
+  else
+    panels[current_panel].dirty = false;
+  panels[current_panel].first_batch = batch_count;
+  panels[current_panel].deferred = false;
+}
 
+void UI::align_widget(const Align &align, const sf::Vector2f &size,
+                      sf::Vector2f &pos, sf::Vector2f &size_to_push) {
   switch (align) {
   case TopLeft:
     break;
@@ -1760,8 +3982,58 @@ bool UI::btn(const std::string &str, const Align &align, size_t char_size,
     size_to_push.x = 0.f;
     break;
   default:
-    ASSERT_MSG(0, "Unreachable state reached in `draw_text`");
+    UNREACHABLE();
+  }
+}
+
+UI::Widget &UI::widget(int id, const std::string &label, size_t char_size,
+                       const Align &align, const sf::Vector2f &avail_pos,
+                       const sf::Vector2f &extra) {
+  Panel &panel = panels[current_panel];
+  if (size_t(id) >= panel.widgets.size())
+    panel.widgets.resize(size_t(id) + 1);
+
+  Widget &w = panel.widgets[size_t(id)];
+  const uint64_t label_hash = hash_fnv1a(label.data(), label.size());
+  if (w.valid && w.label_hash == label_hash && w.char_size == char_size &&
+      w.align == align && w.avail_pos == avail_pos && w.extra == extra)
+    return w;
+
+  w.label_hash = label_hash;
+  w.char_size = char_size;
+  w.align = align;
+  w.avail_pos = avail_pos;
+  w.extra = extra;
+  w.valid = false;
+  panel.dirty = true;
+  return w;
+}
+
+void UI::set_style(Widget &w, uint64_t style) {
+  if (w.style != style) {
+    w.style = style;
+    panels[current_panel].dirty = true;
+  }
+}
+
+bool UI::btn(const std::string &str, const Align &align, size_t char_size,
+             sf::Color col) {
+  ///
+  Layout *l = top_layout();
+  ASSERT(l != nullptr);
+  int id = current_id++;
+
+  sf::Vector2f padding{10.f, 10.f};
+  Widget &w = widget(id, str, char_size, align, l->available_pos());
+  if (!w.valid) {
+    w.pos = w.avail_pos;
+    w.size = d_ptr->get_text_size(str, char_size, padding);
+    w.size_to_push = w.size + padding;
+    align_widget(align, w.size, w.pos, w.size_to_push);
+    w.valid = true;
   }
+  const sf::Vector2f pos = w.pos;
+  const sf::Vector2f size = w.size;
 
   bool click = false;
   sf::FloatRect btn_rect{pos, size};
@@ -1786,14 +4058,15 @@ bool UI::btn(const std::string &str, const Align &align, size_t char_size,
   if (hovering) {
     fill_col.a += 50;
   }
+  set_style(w, fill_col.toInteger());
 
   // draw rect
-  d_ptr->draw_rect(pos - sf::Vector2f{padding.x / 2.f, 0.f}, size, TopLeft,
-                   fill_col);
+  batch::rect(batch_for(nullptr), pos - sf::Vector2f{padding.x / 2.f, 0.f},
+              size, fill_col, sf::Color::White, 1.f);
   // draw text
-  d_ptr->draw_text(pos, str, TopLeft, (int)char_size);
+  push_text(pos, str, char_size, sf::Color::White);
 
-  l->push_widget(size_to_push);
+  l->push_widget(w.size_to_push);
 
   return click;
 }
@@ -1805,50 +4078,16 @@ bool UI::btn_state(bool &state, const std::string &str, const Align &align,
   int id = current_id++;
 
   sf::Vector2f padding{10.f, 10.f};
-  sf::Vector2f pos = l->available_pos();
-  sf::Vector2f size = d_ptr->get_text_size(str, char_size, padding);
-  sf::Vector2f size_to_push{size + padding};
-
-  switch (align) {
-  case TopLeft:
-    break;
-  case TopCenter:
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case TopRight:
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case CenterLeft:
-    pos.y -= size.y / 2.f;
-    // size_to_push.y /= 2.f;
-    break;
-  case CenterCenter:
-    pos -= size / 2.f;
-    // size_to_push /= 2.f;
-    break;
-  case CenterRight:
-    pos.y -= size.y / 2.f;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case BottomLeft:
-    pos.y -= size.y;
-    break;
-  case BottomCenter:
-    pos.y -= size.y;
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case BottomRight:
-    pos.y -= size.y;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  default:
-    ASSERT_MSG(0, "Unreachable state reached in `draw_text`");
+  Widget &w = widget(id, str, char_size, align, l->available_pos());
+  if (!w.valid) {
+    w.pos = w.avail_pos;
+    w.size = d_ptr->get_text_size(str, char_size, padding);
+    w.size_to_push = w.size + padding;
+    align_widget(align, w.size, w.pos, w.size_to_push);
+    w.valid = true;
   }
+  const sf::Vector2f pos = w.pos;
+  const sf::Vector2f size = w.size;
 
   bool click = state;
   sf::FloatRect btn_rect{pos, size};
@@ -1874,14 +4113,15 @@ bool UI::btn_state(bool &state, const std::string &str, const Align &align,
   if (hovering) {
     fill_col.a += 50;
   }
+  set_style(w, fill_col.toInteger());
 
   // draw rect
-  d_ptr->draw_rect(pos - sf::Vector2f{padding.x / 2.f, 0.f}, size, TopLeft,
-                   fill_col);
+  batch::rect(batch_for(nullptr), pos - sf::Vector2f{padding.x / 2.f, 0.f},
+              size, fill_col, sf::Color::White, 1.f);
   // draw text
-  d_ptr->draw_text(pos, str, TopLeft, (int)char_size);
+  push_text(pos, str, char_size, sf::Color::White);
 
-  l->push_widget(size_to_push);
+  l->push_widget(w.size_to_push);
 
   return click;
 }
@@ -1894,55 +4134,22 @@ float UI::slider(float val, float min, float max, const std::string &text,
   ASSERT(l != nullptr);
   int id = current_id++;
 
-  const sf::Vector2f text_size = d_ptr->get_text_size(text, char_size);
-
   sf::Vector2f padding{10.f, 10.f};
   float padding_between_text_and_slider = 10.f;
-  sf::Vector2f pos = l->available_pos() + (padding / 2.f);
-  sf::Vector2f size{text_size.x + padding_between_text_and_slider +
-                        slider_width,
-                    text_size.y};
-  sf::Vector2f size_to_push{size};
-  switch (align) {
-  case TopLeft:
-    break;
-  case TopCenter:
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case TopRight:
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case CenterLeft:
-    pos.y -= size.y / 2.f;
-    // size_to_push.y /= 2.f;
-    break;
-  case CenterCenter:
-    pos -= size / 2.f;
-    // size_to_push /= 2.f;
-    break;
-  case CenterRight:
-    pos.y -= size.y / 2.f;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case BottomLeft:
-    pos.y -= size.y;
-    break;
-  case BottomCenter:
-    pos.y -= size.y;
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case BottomRight:
-    pos.y -= size.y;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  default:
-    UNREACHABLE();
+  Widget &w = widget(id, text, char_size, align, l->available_pos(),
+                     {slider_width, 0.f});
+  if (!w.valid) {
+    w.text_size = d_ptr->get_text_size(text, char_size);
+    w.pos = w.avail_pos + (padding / 2.f);
+    w.size = {w.text_size.x + padding_between_text_and_slider + slider_width,
+              w.text_size.y};
+    w.size_to_push = w.size;
+    align_widget(align, w.size, w.pos, w.size_to_push);
+    w.valid = true;
   }
+  const sf::Vector2f text_size = w.text_size;
+  const sf::Vector2f pos = w.pos;
+  const sf::Vector2f size = w.size;
 
   const sf::Vector2f slider_pos{
       pos.x + text_size.x + padding_between_text_and_slider, pos.y};
@@ -1961,23 +4168,27 @@ float UI::slider(float val, float min, float max, const std::string &text,
     }
   }
 
-  d_ptr->draw_text(pos, text, TopLeft, int(char_size));
+  push_text(pos, text, char_size, sf::Color::White);
 
-  d_ptr->draw_line(slider_pos + sf::Vector2f(0.f, text_size.y / 2.f),
-                   slider_pos + sf::Vector2f(slider_width, text_size.y / 2.f),
-                   col);
+  batch::line(batch_for(nullptr),
+              slider_pos + sf::Vector2f(0.f, text_size.y / 2.f),
+              slider_pos + sf::Vector2f(slider_width, text_size.y / 2.f), col,
+              col, 1.f);
 
   col.a = hovering ? 255 : 100;
+  const float knob_x = math::map(val, min, max, 0.f, slider_width);
+  set_style(w, (uint64_t(col.toInteger()) << 32) |
+                   uint32_t(std::lround(knob_x * 4.f)));
   // d_ptr->draw_rect(
   //     slider_pos + sf::Vector2f{0.f, (text_size.y / 2.f) - text_size.y
   //     / 4.f}, {slider_width, text_size.y / 2.f}, col, col);
 
-  d_ptr->draw_circle(
-      sf::Vector2f{slider_pos.x + math::map(val, min, max, 0.f, slider_width),
-                   slider_pos.y + text_size.y / 2.f},
-      float(char_size / 2.f), col, col);
+  batch::circle(
+      batch_for(nullptr),
+      sf::Vector2f{slider_pos.x + knob_x, slider_pos.y + text_size.y / 2.f},
+      float(char_size / 2.f), col, col, 1.f);
 
-  l->push_widget(size_to_push);
+  l->push_widget(w.size_to_push);
 
   return val;
 }
@@ -1988,61 +4199,20 @@ void UI::text(const std::string &text, const Align &align, size_t char_size,
   ASSERT(l != nullptr);
   int id = current_id++;
 
-  const sf::Vector2f text_size = d_ptr->get_text_size(text, char_size);
   const sf::Vector2f padding{10.f, 10.f};
-  sf::Vector2f pos = l->available_pos() + (padding / 2.f);
-  sf::Vector2f size{text_size};
-
-  sf::Vector2f size_to_push{size};
-  switch (align) {
-  case TopLeft:
-    break;
-  case TopCenter:
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case TopRight:
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case CenterLeft:
-    pos.y -= size.y / 2.f;
-    // size_to_push.y /= 2.f;
-    break;
-  case CenterCenter:
-    pos -= size / 2.f;
-    // size_to_push /= 2.f;
-    break;
-  case CenterRight:
-    pos.y -= size.y / 2.f;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case BottomLeft:
-    pos.y -= size.y;
-    break;
-  case BottomCenter:
-    pos.y -= size.y;
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case BottomRight:
-    pos.y -= size.y;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  default:
-    UNREACHABLE();
+  Widget &w = widget(id, text, char_size, align, l->available_pos());
+  if (!w.valid) {
+    w.pos = w.avail_pos + (padding / 2.f);
+    w.size = d_ptr->get_text_size(text, char_size);
+    w.size_to_push = w.size;
+    align_widget(align, w.size, w.pos, w.size_to_push);
+    w.valid = true;
   }
+  set_style(w, col.toInteger());
 
-  const sf::FloatRect text_rect{pos, size};
-  bool hovering = text_rect.contains(d_ptr->mpos());
+  push_text(w.pos, text, char_size, col);
 
-  // alignment of the text here has to be TopLeft since the alignment is already
-  // taken care of.
-  d_ptr->draw_text(pos, text, TopLeft, int(char_size), col);
-
-  l->push_widget(size_to_push);
+  l->push_widget(w.size_to_push);
 }
 
 void UI::spacing(const sf::Vector2f &size, const Align &align) {
@@ -2050,58 +4220,101 @@ void UI::spacing(const sf::Vector2f &size, const Align &align) {
   ASSERT(l != nullptr);
   int id = current_id++;
 
-  sf::Vector2f pos = l->available_pos();
-
-  sf::Vector2f size_to_push{size};
-
-  switch (align) {
-  case TopLeft:
-    break;
-  case TopCenter:
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case TopRight:
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case CenterLeft:
-    pos.y -= size.y / 2.f;
-    // size_to_push.y /= 2.f;
-    break;
-  case CenterCenter:
-    pos -= size / 2.f;
-    // size_to_push /= 2.f;
-    break;
-  case CenterRight:
-    pos.y -= size.y / 2.f;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  case BottomLeft:
-    pos.y -= size.y;
-    break;
-  case BottomCenter:
-    pos.y -= size.y;
-    pos.x -= size.x / 2.f;
-    size_to_push.x /= 2.f;
-    break;
-  case BottomRight:
-    pos.y -= size.y;
-    pos.x -= size.x;
-    size_to_push.x = 0.f;
-    break;
-  default:
-    UNREACHABLE();
+  Widget &w = widget(id, {}, 0, align, l->available_pos(), size);
+  if (!w.valid) {
+    w.pos = w.avail_pos;
+    w.size = size;
+    w.size_to_push = size;
+    align_widget(align, w.size, w.pos, w.size_to_push);
+    w.valid = true;
   }
 
-  l->push_widget(size_to_push);
+  l->push_widget(w.size_to_push);
 }
 
-void UI::end() {
+bool UI::end(bool submit) {
   ///
+  Panel &panel = panels[current_panel];
+  // widgets that weren't submitted this time
+  if (size_t(current_id) < panel.widgets.size()) {
+    panel.widgets.resize(size_t(current_id));
+    panel.dirty = true;
+  }
   current_id = 0;
   layouts.pop_back();
+
+  // with some slack for button padding, outlines and slider knobs
+  const float slack = 5.f;
+  panel.prev_bounds = panel.bounds;
+  panel.bounds = {};
+  for (auto &w : panel.widgets) {
+    const sf::FloatRect r{w.pos - sf::Vector2f{slack, slack},
+                          w.size + sf::Vector2f{slack, slack} * 2.f};
+    if (panel.bounds.width == 0.f)
+      panel.bounds = r;
+    else
+      panel.bounds = rect_union(panel.bounds, r);
+  }
+
+  panel.end_batch = batch_count;
+  panel.deferred = !submit;
+  if (submit)
+    draw_batches(panel.first_batch, panel.end_batch);
+  return panel.dirty;
+}
+
+sf::FloatRect UI::changed_bounds() const {
+  const Panel &panel = panels[current_panel];
+  if (panel.prev_bounds.width == 0.f)
+    return panel.bounds;
+  return rect_union(panel.bounds, panel.prev_bounds);
+}
+
+sf::VertexArray &UI::batch_for(const sf::Texture *texture) {
+  for (size_t i = panels[current_panel].first_batch; i < batch_count; ++i) {
+    if (batches[i].texture == texture)
+      return batches[i].vertices;
+  }
+
+  if (batch_count == batches.size())
+    batches.emplace_back();
+  Batch &b = batches[batch_count++];
+  b.texture = texture;
+  b.vertices.clear();
+  return b.vertices;
+}
+
+void UI::push_text(const sf::Vector2f &pos, const std::string &str,
+                   size_t char_size, sf::Color col) {
+  const sf::Font &font = d_ptr->res_man.get_font(d_ptr->default_font_id);
+  batch::text(batch_for(&font.getTexture(unsigned(char_size))), font, str,
+              unsigned(char_size), pos, col);
+}
+
+void UI::draw() {
+  // in panel order, so later panels still cover earlier ones
+  for (size_t i = 0; i < panels_begun; ++i) {
+    if (panels[i].deferred)
+      draw_batches(panels[i].first_batch, panels[i].end_batch);
+  }
+}
+
+void UI::draw_batches(size_t first, size_t end) {
+  // one draw per batch; solid geometry first, so text lands on top of the
+  // button and slider rects it belongs to
+  for (size_t i = first; i < end; ++i) {
+    if (batches[i].texture == nullptr &&
+        batches[i].vertices.getVertexCount() > 0)
+      d_ptr->draw(batches[i].vertices);
+  }
+  for (size_t i = first; i < end; ++i) {
+    Batch &b = batches[i];
+    if (b.texture == nullptr || b.vertices.getVertexCount() == 0)
+      continue;
+    sf::RenderStates states;
+    states.texture = b.texture;
+    d_ptr->draw(b.vertices, states);
+  }
 }
 
 UI::Layout::Layout() : pos(0.f, 0.f), size(0.f, 0.f), padding(4.f, 4.f) {}
@@ -2198,6 +4411,177 @@ sf::Color inv(const sf::Color &col) {
   return result;
 }
 }; // namespace col
+
+// batch --------------------------------------------------
+namespace batch {
+void quad(sf::VertexArray &va, const sf::Vector2f &tl, const sf::Vector2f &br,
+          sf::Color col) {
+  if (col.a == 0)
+    return;
+  const sf::Vector2f tr{br.x, tl.y}, bl{tl.x, br.y};
+  va.append({tl, col});
+  va.append({tr, col});
+  va.append({bl, col});
+  va.append({bl, col});
+  va.append({tr, col});
+  va.append({br, col});
+}
+
+void rect(sf::VertexArray &va, const sf::Vector2f &pos,
+          const sf::Vector2f &size, sf::Color fill_col, sf::Color out_col,
+          float out_thic) {
+  if (size.x <= 0.f || size.y <= 0.f)
+    return;
+  // same placement as Data::draw_rect: the body is inset by the outline
+  // thickness and the outline grows outwards from it
+  const sf::Vector2f in_tl = pos + sf::Vector2f{out_thic, out_thic};
+  const sf::Vector2f in_br = pos + size;
+  quad(va, in_tl, in_br, fill_col);
+  if (out_thic <= 0.f)
+    return;
+  const sf::Vector2f out_tl = pos;
+  const sf::Vector2f out_br = in_br + sf::Vector2f{out_thic, out_thic};
+  quad(va, out_tl, {out_br.x, in_tl.y}, out_col);
+  quad(va, {out_tl.x, in_br.y}, out_br, out_col);
+  quad(va, {out_tl.x, in_tl.y}, {in_tl.x, in_br.y}, out_col);
+  quad(va, {in_br.x, in_tl.y}, {out_br.x, in_br.y}, out_col);
+}
+
+void circle(sf::VertexArray &va, const sf::Vector2f &center, float radius,
+            sf::Color fill_col, sf::Color out_col, float out_thic,
+            size_t point_count) {
+  if (radius <= 0.f || point_count < 3)
+    return;
+  auto point = [&](size_t i, float r) {
+    const float angle = float(i) * 2.f * float(PI) / float(point_count) -
+                        float(PI) / 2.f;
+    return center + sf::Vector2f{std::cos(angle), std::sin(angle)} * r;
+  };
+  for (size_t i = 0; i < point_count && fill_col.a != 0; ++i) {
+    va.append({center, fill_col});
+    va.append({point(i, radius), fill_col});
+    va.append({point(i + 1, radius), fill_col});
+  }
+  if (out_thic <= 0.f || out_col.a == 0)
+    return;
+  for (size_t i = 0; i < point_count; ++i) {
+    const sf::Vector2f a = point(i, radius), b = point(i + 1, radius);
+    const sf::Vector2f c = point(i, radius + out_thic),
+                       e = point(i + 1, radius + out_thic);
+    va.append({a, out_col});
+    va.append({c, out_col});
+    va.append({b, out_col});
+    va.append({b, out_col});
+    va.append({c, out_col});
+    va.append({e, out_col});
+  }
+}
+
+void line(sf::VertexArray &va, const sf::Vector2f &p1, const sf::Vector2f &p2,
+          sf::Color col1, sf::Color col2, float thic) {
+  const sf::Vector2f n = v2f::normal(v2f::normalize(p2 - p1)) * (thic / 2.f);
+  va.append({p1 + n, col1});
+  va.append({p2 + n, col2});
+  va.append({p1 - n, col1});
+  va.append({p1 - n, col1});
+  va.append({p2 + n, col2});
+  va.append({p2 - n, col2});
+}
+
+void text(sf::VertexArray &va, const sf::Font &font, const std::string &str,
+          unsigned int char_size, const sf::Vector2f &pos, sf::Color col) {
+  const float whitespace = font.getGlyph(L' ', char_size, false).advance;
+  const float line_spacing = font.getLineSpacing(char_size);
+  float x = 0.f;
+  float y = float(char_size);
+
+  sf::Uint32 prev = 0;
+  for (char c : str) {
+    const sf::Uint32 ch = sf::Uint8(c);
+    if (ch == '\r')
+      continue;
+    x += font.getKerning(prev, ch, char_size);
+    prev = ch;
+
+    if (ch == ' ' || ch == '\t' || ch == '\n') {
+      if (ch == ' ')
+        x += whitespace;
+      else if (ch == '\t')
+        x += whitespace * 4.f;
+      else {
+        y += line_spacing;
+        x = 0.f;
+      }
+      continue;
+    }
+
+    const sf::Glyph &glyph = font.getGlyph(ch, char_size, false);
+    const float padding = 1.f;
+    const float left = glyph.bounds.left - padding;
+    const float top = glyph.bounds.top - padding;
+    const float right = glyph.bounds.left + glyph.bounds.width + padding;
+    const float bottom = glyph.bounds.top + glyph.bounds.height + padding;
+    const float u1 = float(glyph.textureRect.left) - padding;
+    const float v1 = float(glyph.textureRect.top) - padding;
+    const float u2 =
+        float(glyph.textureRect.left + glyph.textureRect.width) + padding;
+    const float v2 =
+        float(glyph.textureRect.top + glyph.textureRect.height) + padding;
+
+    const sf::Vector2f o = pos + sf::Vector2f{x, y};
+    va.append({o + sf::Vector2f{left, top}, col, {u1, v1}});
+    va.append({o + sf::Vector2f{right, top}, col, {u2, v1}});
+    va.append({o + sf::Vector2f{left, bottom}, col, {u1, v2}});
+    va.append({o + sf::Vector2f{left, bottom}, col, {u1, v2}});
+    va.append({o + sf::Vector2f{right, top}, col, {u2, v1}});
+    va.append({o + sf::Vector2f{right, bottom}, col, {u2, v2}});
+
+    x += glyph.advance;
+  }
+}
+
+sf::Vector2f text_size(const sf::Font &font, const std::string &str,
+                       unsigned int char_size) {
+  if (str.empty())
+    return {};
+
+  // same walk as batch::text, tracking the extents the way sf::Text does
+  const float whitespace = font.getGlyph(L' ', char_size, false).advance;
+  const float line_spacing = font.getLineSpacing(char_size);
+  float x = 0.f;
+  float y = float(char_size);
+  float max_x = 0.f, max_y = 0.f;
+
+  sf::Uint32 prev = 0;
+  for (char c : str) {
+    const sf::Uint32 ch = sf::Uint8(c);
+    if (ch == '\r')
+      continue;
+    x += font.getKerning(prev, ch, char_size);
+    prev = ch;
+
+    if (ch == ' ' || ch == '\t' || ch == '\n') {
+      if (ch == ' ')
+        x += whitespace;
+      else if (ch == '\t')
+        x += whitespace * 4.f;
+      else {
+        y += line_spacing;
+        x = 0.f;
+      }
+      max_x = std::max(max_x, x);
+      max_y = std::max(max_y, y);
+      continue;
+    }
+
+    const sf::Glyph &glyph = font.getGlyph(ch, char_size, false);
+    max_x = std::max(max_x, x + glyph.bounds.left + glyph.bounds.width);
+    max_y = std::max(max_y, y + glyph.bounds.top + glyph.bounds.height);
+    x += glyph.advance;
+  }
+  return {max_x, max_y};
+}
+}; // namespace batch
 // text_box --------------------------------------------------
 Text_box::Text_box(Data &_d, const sf::Vector2f &_pos,
                    sf::Vector2u _size_in_chars, int _char_size)
@@ -2248,20 +4632,56 @@ bool Text_box::close_animate() {
   return size != sf::Vector2f{0.f, 0.f};
 }
 
-void Text_box::push_text() {
-  current_text_size = d->get_text_size(texts.back(), char_size);
-  if (current_text_size.x < size.x - (padding.x * 2.f)) {
-    texts.back().push_back(text_buffer[current_text_id].text[current_char]);
-    current_char++;
-  } else {
-    if (texts.size() + 1 <= size_in_chars.y) {
-      texts.push_back(std::string());
-    }
+static float glyph_advance(const sf::Font &font, sf::Uint32 prev,
+                           sf::Uint32 ch, unsigned int char_size) {
+  float advance = font.getGlyph(ch, char_size, false).advance;
+  if (prev != 0)
+    advance += font.getKerning(prev, ch, char_size);
+  return advance;
+}
+
+// returns false when the next line doesn't fit in the box
+bool Text_box::push_text() {
+  if (page_full())
+    return false;
+
+  const Dialog &dialog = text_buffer[current_text_id];
+  if (current_line < dialog.line_breaks.size() &&
+      dialog.line_breaks[current_line] == size_t(current_char)) {
+    texts.push_back(std::string());
+    current_line++;
+    current_text_size = {};
   }
+
+  const sf::Font &font = d->res_man.get_font(d->default_font_id);
+  const sf::Uint32 prev =
+      texts.back().empty() ? 0 : sf::Uint8(texts.back().back());
+  const char ch = dialog.text[current_char];
+  current_text_size.x +=
+      glyph_advance(font, prev, sf::Uint8(ch), unsigned(char_size));
+  current_text_size.y = float(char_size);
+  texts.back().push_back(ch);
+  current_char++;
+  return true;
 }
 
 bool Text_box::text_fully_drawn() const {
-  return texts.back() == text_buffer[current_text_id].text;
+  return size_t(current_char) >= text_buffer[current_text_id].text.size();
+}
+
+bool Text_box::page_full() const {
+  const Dialog &dialog = text_buffer[current_text_id];
+  return current_line < dialog.line_breaks.size() &&
+         dialog.line_breaks[current_line] == size_t(current_char) &&
+         texts.size() >= size_in_chars.y;
+}
+
+void Text_box::next_page() {
+  // the line break that didn't fit starts the new page
+  texts.clear();
+  texts.push_back(std::string());
+  current_line++;
+  current_text_size = {};
 }
 
 void Text_box::update() {
@@ -2290,10 +4710,13 @@ void Text_box::update() {
       text_buffer[current_text_id].func();
     }
     size_t current_text_len = text_buffer[current_text_id].text.size();
-    // not fully drawn
+    // not fully drawn: finish the page, or turn it once it is full
     if (current_char < current_text_len) {
-      while (!text_fully_drawn() && current_char < current_text_len) {
-        push_text();
+      if (page_full()) {
+        next_page();
+      } else {
+        while (!text_fully_drawn() && push_text()) {
+        }
       }
     }
     // fully drawn
@@ -2301,6 +4724,8 @@ void Text_box::update() {
       if (current_text_id + 1 < text_buffer.size()) {
         current_text_id++;
         current_char = 0;
+        current_line = 0;
+        current_text_size = {};
         texts.clear();
         texts.push_back(std::string());
       } else {
@@ -2331,8 +4756,27 @@ void Text_box::draw() {
 }
 
 void Text_box::add_text(const std::string &txt, std::function<void()> func) {
-  //
-  text_buffer.push_back({txt, func, false});
+  Dialog dialog{txt, func, false};
+
+  // wrap once a line is at least as wide as the box, like push_text used to
+  // check per character. Characters are only revealed once open_animate()
+  // has reached actual_size, so that is the width they were checked against.
+  const sf::Font &font = d->res_man.get_font(d->default_font_id);
+  const float max_width = actual_size.x - (padding.x * 2.f);
+  float width = 0.f;
+  sf::Uint32 prev = 0;
+  for (size_t i = 0; i < txt.size(); ++i) {
+    if (width >= max_width) {
+      dialog.line_breaks.push_back(i);
+      width = 0.f;
+      prev = 0;
+    }
+    const sf::Uint32 ch = sf::Uint8(txt[i]);
+    width += glyph_advance(font, prev, ch, unsigned(char_size));
+    prev = ch;
+  }
+
+  text_buffer.push_back(std::move(dialog));
 }
 
 // math -------------------------
@@ -2451,4 +4895,74 @@ sf::Vector2f from_radians(float rad) {
 
 } // namespace v2f
 } // namespace sh
+
+// allocation tracking --------------------------------------------------
+#ifdef SH_TRACK_ALLOCATIONS
+static void sh_count_allocation(std::size_t size) {
+  sh::Alloc_stats::allocations.fetch_add(1, std::memory_order_relaxed);
+  sh::Alloc_stats::bytes.fetch_add(size, std::memory_order_relaxed);
+  sh::Alloc_stats::thread_allocations++;
+  sh::Alloc_stats::thread_bytes += size;
+}
+
+void *operator new(std::size_t size) {
+  sh_count_allocation(size);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept {
+  if (!p)
+    return;
+  sh::Alloc_stats::frees.fetch_add(1, std::memory_order_relaxed);
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, std::size_t) noexcept { operator delete(p); }
+
+// over-aligned types (alignas > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+void *operator new(std::size_t size, std::align_val_t align) {
+  sh_count_allocation(size);
+  const std::size_t a = std::size_t(align);
+#ifdef _WIN32
+  void *p = _aligned_malloc(size ? size : 1, a);
+#else
+  // aligned_alloc wants the size to be a multiple of the alignment
+  void *p = std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a);
+#endif
+  if (p)
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  if (!p)
+    return;
+  sh::Alloc_stats::frees.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void operator delete[](void *p, std::align_val_t align) noexcept {
+  operator delete(p, align);
+}
+void operator delete(void *p, std::size_t, std::align_val_t align) noexcept {
+  operator delete(p, align);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t align) noexcept {
+  operator delete(p, align);
+}
+#endif
 #endif
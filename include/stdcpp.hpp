@@ -5,6 +5,12 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <thread>
+#include <cstring>
 
 #if defined USE_WIN32
 #define WIN32_MEAN_AND_LEAN
@@ -21,7 +27,80 @@ std::string last_error_str();
 }; // namespace win
 #endif
 
-#define VAR(name) print("{}: {}\n", #name, name)
+// logger --------------------------------------------------
+// Messages are formatted by the caller straight into a fixed slot of a
+// lock-free ring and written out by a background thread, so logging never
+// blocks on I/O. Levels below LOG_MIN_LEVEL compile to nothing. Trace and
+// Debug messages (the per-frame ones) are dropped when the ring is full and
+// truncated to a slot; the background thread writes how many were dropped to
+// stderr once it has caught up (see also logger::dropped()). Info and up,
+// which includes print(), wait for a free slot and are never cut short.
+enum class Log_level { Trace, Debug, Info, Warning, Error };
+
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL Log_level::Info
+#else
+#define LOG_MIN_LEVEL Log_level::Trace
+#endif
+#endif
+
+namespace logger {
+constexpr size_t SLOT_SIZE = 512;
+constexpr size_t SLOT_COUNT = 512;
+
+struct Slot {
+  std::atomic<size_t> seq;
+  Log_level level;
+  size_t len;
+  char text[SLOT_SIZE];
+  // the whole text of a lossless message that didn't fit in `text`, freed by
+  // the background thread once written
+  std::string *long_text{nullptr};
+};
+
+constexpr bool lossless(Log_level level) { return level >= Log_level::Info; }
+
+// claims the next slot; when the ring is full, a lossless level waits for a
+// slot, the others get nullptr (and a dropped message)
+Slot *begin_write(size_t &pos, Log_level level);
+// publishes a claimed slot; `len` may exceed SLOT_SIZE, the text is then
+// truncated unless `slot->long_text` holds all of it
+void end_write(Slot *slot, size_t pos, Log_level level, size_t len);
+// blocks until everything logged so far has been written
+void flush();
+size_t dropped();
+
+template <typename... Args>
+void write(Log_level level, std::format_string<Args...> fmt, Args &&...args) {
+  size_t pos;
+  Slot *slot = begin_write(pos, level);
+  if (!slot)
+    return;
+  // formatting only reads the arguments, so they can be formatted again
+  const auto res =
+      std::format_to_n(slot->text, SLOT_SIZE, fmt, std::forward<Args>(args)...);
+  if (size_t(res.size) > SLOT_SIZE && lossless(level)) {
+    slot->long_text = new std::string(size_t(res.size), '\0');
+    std::format_to_n(slot->long_text->data(), res.size, fmt,
+                     std::forward<Args>(args)...);
+  }
+  end_write(slot, pos, level, size_t(res.size));
+}
+} // namespace logger
+
+#define LOG_AT(level, str, ...)                                                \
+  do {                                                                         \
+    if constexpr ((level) >= LOG_MIN_LEVEL)                                    \
+      logger::write((level), (str), __VA_ARGS__);                              \
+  } while (0)
+#define LOG_TRACE(str, ...) LOG_AT(Log_level::Trace, str, __VA_ARGS__)
+#define LOG_DEBUG(str, ...) LOG_AT(Log_level::Debug, str, __VA_ARGS__)
+#define LOG_INFO(str, ...) LOG_AT(Log_level::Info, str, __VA_ARGS__)
+#define LOG_WARN(str, ...) LOG_AT(Log_level::Warning, str, __VA_ARGS__)
+#define LOG_ERROR(str, ...) LOG_AT(Log_level::Error, str, __VA_ARGS__)
+
+#define VAR(name) LOG_DEBUG("{}: {}\n", #name, name)
 #define VAR_STR(name) std::format("{}: {}", #name, name)
 #define NL() print("\n")
 #define ASSERT(condition)                                                      \
@@ -37,27 +116,63 @@ std::string last_error_str();
 #define PANIC(str, ...) panic(FMT("{}:{}: "str, __FILE__, __LINE__,  __VA_ARGS__))
 void panic();
 template <typename T, typename... Types> void panic(T arg, Types... args) {
+  // get pending log messages out before dying
+  logger::flush();
   std::cerr << arg;
   panic(args...);
 }
-#define LOG(...) log(__VA_ARGS__)
-void log();
-template <typename T, typename... Types> void log(T arg, Types... args) {
-  std::cout << arg;
-  log(args...);
+#define LOG(...) log<Log_level::Info>(__VA_ARGS__)
+// concatenates its arguments into one log message
+template <Log_level level, typename... Types> void log(const Types &...args) {
+  if constexpr (level >= LOG_MIN_LEVEL) {
+    size_t pos;
+    logger::Slot *slot = logger::begin_write(pos, level);
+    if (!slot)
+      return;
+    size_t len = 0;
+    ((len += size_t(std::format_to_n(
+                        slot->text + std::min(len, logger::SLOT_SIZE),
+                        logger::SLOT_SIZE - std::min(len, logger::SLOT_SIZE),
+                        "{}", args)
+                        .size)),
+     ...);
+    if (len > logger::SLOT_SIZE && logger::lossless(level)) {
+      slot->long_text = new std::string();
+      slot->long_text->reserve(len);
+      ((std::format_to(std::back_inserter(*slot->long_text), "{}", args)), ...);
+    }
+    logger::end_write(slot, pos, level, len);
+  }
 }
 #define UNREACHABLE() PANIC("Uncreachable\n")
 #define UNIMPLEMENTED() PANIC("{}() is unimplemented\n", __func__)
-#define WARNING(...) LOG("WARNING: ", __VA_ARGS__)
-#define FMT(str, ...) std::format((str), __VA_ARGS__)
-#define fprint(file, str, ...) __print((file), FMT((str), __VA_ARGS__))
-#define print(str, ...) fprint(std::cout, str, __VA_ARGS__)
+#define WARNING(...) log<Log_level::Warning>("WARNING: ", __VA_ARGS__)
+#define fprint(file, str, ...) __print((file), (str), __VA_ARGS__)
+#define print(str, ...) LOG_INFO(str, __VA_ARGS__)
+
+// Formats into `out`, reusing its capacity instead of allocating a new string.
+template <typename... Args>
+void format_into(std::string &out, std::format_string<Args...> fmt,
+                 Args &&...args) {
+  out.clear();
+  std::format_to(std::back_inserter(out), fmt, std::forward<Args>(args)...);
+}
 
-void __print(std::ostream &file);
-template <typename T, typename... Types>
-void __print(std::ostream &file, T arg, Types... args) {
-  file << arg;
-  __print(file, args...);
+// Formats on the stack and hands the result to `file` in one write; output that
+// doesn't fit goes through a per-thread string that keeps its capacity.
+template <typename... Args>
+void __print(std::ostream &file, std::format_string<Args...> fmt,
+             Args &&...args) {
+  char buf[1024];
+  const auto res =
+      std::format_to_n(buf, sizeof(buf), fmt, std::forward<Args>(args)...);
+  if (size_t(res.size) <= sizeof(buf)) {
+    file.write(buf, res.size);
+    return;
+  }
+  thread_local std::string big;
+  format_into(big, fmt, std::forward<Args>(args)...);
+  file.write(big.data(), big.size());
 }
 
 #define ARG() Arg arg(argc, argv)
@@ -168,11 +283,141 @@ std::string last_error_str(){
 
 #endif
 
-void __print(std::ostream &file){};
+void panic() { exit(1); };
 
-void log(){};
+// logger --------------------------------------------------
+namespace logger {
+// Bounded MPMC queue (one consumer here): a slot is free for the producer
+// claiming position `pos` when its seq == pos, and ready for the consumer
+// when seq == pos + 1.
+struct State;
+static State &state();
+
+struct State {
+  Slot slots[SLOT_COUNT];
+  std::atomic<size_t> head{0};      // next position to claim
+  std::atomic<size_t> written{0};   // positions handed to stdio
+  std::atomic<uint32_t> published{0}; // bumped (and notified) per message
+  std::atomic<size_t> dropped{0};
+  size_t dropped_reported{0}; // drain thread only
+  std::atomic<bool> exiting{false}; // after main, messages are waited for
+
+  // never destroyed (see state()), so the thread runs until the process ends
+  // and logging from static destructors stays safe
+  State() {
+    for (size_t i = 0; i < SLOT_COUNT; ++i)
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    std::thread([this] { run(); }).detach();
+    // write out what is still queued when main returns or exit() is called,
+    // and from then on (static destructors) each message as it is logged
+    std::atexit([] {
+      state().exiting = true;
+      flush();
+    });
+  }
 
-void panic() { exit(1); };
+  // returns true if anything was written
+  bool drain(size_t &tail) {
+    bool any = false;
+    for (;;) {
+      Slot &slot = slots[tail % SLOT_COUNT];
+      if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+        break;
+      FILE *out = slot.level >= Log_level::Error ? stderr : stdout;
+      if (slot.long_text) {
+        std::fwrite(slot.long_text->data(), 1, slot.long_text->size(), out);
+        delete slot.long_text;
+        slot.long_text = nullptr;
+      } else {
+        std::fwrite(slot.text, 1, slot.len, out);
+      }
+      slot.seq.store(tail + SLOT_COUNT, std::memory_order_release);
+      tail++;
+      any = true;
+    }
+    // messages are only dropped while the ring is full, so by the time it is
+    // empty again the count has stopped moving for this burst
+    const size_t now_dropped = dropped.load(std::memory_order_relaxed);
+    if (now_dropped != dropped_reported) {
+      std::fprintf(stderr, "WARNING: %zu log messages dropped\n",
+                   now_dropped - dropped_reported);
+      dropped_reported = now_dropped;
+      any = true;
+    }
+    if (any) {
+      std::fflush(stdout);
+      std::fflush(stderr);
+      written.store(tail, std::memory_order_release);
+    }
+    return any;
+  }
+
+  void run() {
+    size_t tail = 0;
+    for (;;) {
+      const uint32_t seen = published.load(std::memory_order_acquire);
+      if (drain(tail))
+        continue;
+      published.wait(seen);
+    }
+  }
+};
+
+static State &state() {
+  static State *s = new State;
+  return *s;
+}
+
+Slot *begin_write(size_t &pos, Log_level level) {
+  State &st = state();
+  pos = st.head.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot &slot = st.slots[pos % SLOT_COUNT];
+    const size_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq == pos) {
+      if (st.head.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+        return &slot;
+    } else if (seq < pos) {
+      if (!lossless(level)) {
+        // full: the writer is behind, drop rather than wait on it
+        st.dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      // full: wait for the writer to free a slot
+      std::this_thread::yield();
+      pos = st.head.load(std::memory_order_relaxed);
+    } else {
+      pos = st.head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void end_write(Slot *slot, size_t pos, Log_level level, size_t len) {
+  if (len > SLOT_SIZE && !slot->long_text) {
+    len = SLOT_SIZE;
+    std::memcpy(slot->text + SLOT_SIZE - 4, "...\n", 4);
+  }
+  slot->level = level;
+  slot->len = len;
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  State &st = state();
+  st.published.fetch_add(1, std::memory_order_release);
+  st.published.notify_one();
+  if (st.exiting.load(std::memory_order_relaxed))
+    flush();
+}
+
+void flush() {
+  State &st = state();
+  const size_t target = st.head.load();
+  while (st.written.load(std::memory_order_acquire) < target)
+    std::this_thread::yield();
+}
+
+size_t dropped() { return state().dropped.load(); }
+} // namespace logger
 
 // Arg --------------------------------------------------
 Arg::Arg(int &_argc, char **&_argv) {
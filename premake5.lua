@@ -1,8 +1,22 @@
+-- `premake5 --profiler <action>` builds with the frame profiler (F2 dumps
+-- trace.json for chrome://tracing)
+newoption {
+    trigger = "profiler",
+    description = "Compile in PROFILE_SCOPE markers (SH_PROFILER)"
+}
+
+-- `premake5 --track-allocations <action>` counts heap allocations
+-- (Data::frame_allocations); wpm-alloc-check always has it on
+newoption {
+    trigger = "track-allocations",
+    description = "Replace global operator new/delete with counting ones (SH_TRACK_ALLOCATIONS)"
+}
+
 workspace "wpm"
     configurations {"Debug", "Release"}
     location "build"
 
-project "wpm"
+function sfml_project()
     kind "ConsoleApp"
     language "C++"
     architecture "x64"
@@ -10,44 +24,65 @@ project "wpm"
     staticruntime "On"
     targetdir "bin/%{cfg.buildcfg}"
 
-files {"src/**.cpp"}
-includedirs {"include"}
-
-defines {"SFML_STATIC"}
-
--- sfml deps {in windows}
-links {"opengl32.lib"}
-links {"winmm.lib"}
-links {"ws2_32.lib"}
-
--- sfml deps {ext}
-links {"lib/flac.lib"}
-links {"lib/freetype.lib"}
-links {"lib/openal32.lib"}
-links {"lib/vorbis.lib"}
-links {"lib/vorbisenc.lib"}
-links {"lib/vorbisfile.lib"}
-links {"lib/ogg.lib"}
-
-filter "configurations:Debug"
-    runtime "Debug"
-    defines {"DEBUG"}
-    symbols "On"
-    links {"lib/Debug/sfml-audio-s-d.lib"}
-    links {"lib/Debug/sfml-graphics-s-d.lib"}
-    links {"lib/Debug/sfml-network-s-d.lib"}
-    links {"lib/Debug/sfml-system-s-d.lib"}
-    links {"lib/Debug/sfml-window-s-d.lib"}
-
-filter "configurations:Release"
-    runtime "Release"
-    defines {"NDEBUG"}
-    optimize "On"
-    links {"lib/Release/sfml-audio-s.lib"}
-    links {"lib/Release/sfml-graphics-s.lib"}
-    links {"lib/Release/sfml-network-s.lib"}
-    links {"lib/Release/sfml-system-s.lib"}
-    links {"lib/Release/sfml-window-s.lib"}
-
-filter {}
-----------------------------------------------------
+    includedirs {"include"}
+
+    defines {"SFML_STATIC"}
+
+    filter "options:profiler"
+        defines {"SH_PROFILER"}
+    filter "options:track-allocations"
+        defines {"SH_TRACK_ALLOCATIONS"}
+    filter {}
+
+    -- sfml deps {in windows}
+    links {"opengl32.lib"}
+    links {"winmm.lib"}
+    links {"ws2_32.lib"}
+
+    -- sfml deps {ext}
+    links {"lib/flac.lib"}
+    links {"lib/freetype.lib"}
+    links {"lib/openal32.lib"}
+    links {"lib/vorbis.lib"}
+    links {"lib/vorbisenc.lib"}
+    links {"lib/vorbisfile.lib"}
+    links {"lib/ogg.lib"}
+
+    filter "configurations:Debug"
+        runtime "Debug"
+        defines {"DEBUG"}
+        symbols "On"
+        links {"lib/Debug/sfml-audio-s-d.lib"}
+        links {"lib/Debug/sfml-graphics-s-d.lib"}
+        links {"lib/Debug/sfml-network-s-d.lib"}
+        links {"lib/Debug/sfml-system-s-d.lib"}
+        links {"lib/Debug/sfml-window-s-d.lib"}
+
+    filter "configurations:Release"
+        runtime "Release"
+        defines {"NDEBUG"}
+        optimize "On"
+        links {"lib/Release/sfml-audio-s.lib"}
+        links {"lib/Release/sfml-graphics-s.lib"}
+        links {"lib/Release/sfml-network-s.lib"}
+        links {"lib/Release/sfml-system-s.lib"}
+        links {"lib/Release/sfml-window-s.lib"}
+
+    filter {}
+end
+
+project "wpm"
+    sfml_project()
+    files {"src/**.cpp"}
+
+-- packs assets into data.dat: `wpm-pack res` or `wpm-pack assets.txt`
+project "wpm-pack"
+    sfml_project()
+    files {"tools/pack.cpp"}
+
+-- runs the typing test's frames (src/typing_test.hpp) in a hidden window and
+-- fails if one allocates on the main thread; run it next to data.dat
+project "wpm-alloc-check"
+    sfml_project()
+    files {"tools/alloc_check.cpp"}
+    defines {"SH_TRACK_ALLOCATIONS"}
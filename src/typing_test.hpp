@@ -0,0 +1,632 @@
+#ifndef _TYPING_TEST_H_
+#define _TYPING_TEST_H_
+
+// The typing test screen: the keyboard, the passage and the HUD, each cached
+// in a layer and only redrawn where it changed. main() runs frame() in a
+// loop; tools/alloc_check.cpp runs the same frames to check they don't
+// allocate. Include it after the sfml-helper implementation, in one
+// translation unit.
+
+#define KEY_SIZE 48.f
+#define UPPER_PAD (KEY_SIZE * 0.25f)
+#define KEY_PAD (KEY_SIZE * 0.05f)
+
+#define TAB_SIZE (KEY_SIZE * 1.5f)
+#define CAPS_SIZE (KEY_SIZE * 1.75f)
+#define SHIFT_SIZE (KEY_SIZE * 2.05f)
+#define RSHIFT_SIZE (KEY_SIZE * 2.95f)
+#define SPACE_SIZE (KEY_SIZE * 6.f)
+#define BOTTOM_KEY_SIZE (KEY_SIZE * 1.28f)
+#define BACKSLASH_SIZE TAB_SIZE
+#define ENTER_SIZE (KEY_SIZE * 2.25f)
+#define BACKSPACE_SIZE (KEY_SIZE * 2.f)
+
+#define NUM_X                                                                  \
+  ((BOTTOM_KEY_SIZE * 3) + SPACE_SIZE + (BOTTOM_KEY_SIZE * 4) + UPPER_PAD +    \
+   (KEY_SIZE * 3) + UPPER_PAD)
+
+struct Typing_test {
+  Data &d;
+  UI ui;
+  std::string text;
+  std::string buffer{};
+  float time_passed{0.f}, time_done{0.f};
+  float character_per_sec{0.f};
+  bool done{false};
+
+  // where each key was drawn and whether it was held, so only keys whose
+  // state changed get redrawn
+  sf::FloatRect key_rects[size_t(Key::KeyCount)]{};
+  bool key_drawn_held[size_t(Key::KeyCount)]{};
+  sf::View keyboard_view;
+  // the cell of every character of the passage (empty for line breaks), tall
+  // enough for descenders
+  std::vector<sf::FloatRect> cells;
+
+  // the keyboard, the passage and the HUD are only redrawn when they change
+  Layer &keyboard_layer;
+  Layer &passage_layer;
+  Layer &hud_layer;
+  std::string drawn_buffer{};
+  bool show_render_stats{false};
+
+  // HUD text is formatted into reused strings, so an idle frame doesn't
+  // allocate
+  std::string time_str, cps_str, lat_str;
+
+  Typing_test(Data &_d, const std::string &_text);
+
+  void draw_key_ex(Key key, sf::Vector2f pos, float width,
+                   const std::string &key_str, const int char_size = -1);
+  void draw_key(Key key, sf::Vector2f pos, const std::string &key_str,
+                const int char_size = -1);
+  void draw_keys(Key key);
+  void draw_keyboard();
+  void draw_passage();
+  // waits for input (or the next clock tick), then updates and draws
+  void frame();
+};
+
+Typing_test::Typing_test(Data &_d, const std::string &_text)
+    : d(_d), ui(_d), text(_text), keyboard_layer(_d.create_layer()),
+      passage_layer(_d.create_layer()), hud_layer(_d.create_layer()) {
+  // sizes drawn during a test: passage/HUD and the latency line
+  d.prewarm_glyphs(text, {DEFAULT_CHAR_SIZE, DEFAULT_CHAR_SIZE / 2});
+
+  cells.resize(text.size());
+  const float char_spacing{2.f};
+  const sf::Vector2f cell_size{DEFAULT_CHAR_SIZE/2.f + char_spacing, DEFAULT_CHAR_SIZE * 1.5f};
+  sf::Vector2f text_pos{20.f, 20.f};
+  size_t pos_i = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\r' || text[i] == '\n'){
+      text_pos.y += DEFAULT_CHAR_SIZE + 2.f;
+      pos_i = 0;
+      continue;
+    }
+    cells[i] = {text_pos + sf::Vector2f{float(pos_i) * cell_size.x, 0.f}, cell_size};
+    pos_i++;
+  }
+
+  for (auto *s : {&time_str, &cps_str, &lat_str})
+    s->reserve(64);
+  drawn_buffer.reserve(text.size());
+  buffer.reserve(text.size() + 1);
+
+  // only render when there is input or the clock text changes
+  d.set_on_demand(true);
+  d.set_frame_pacing(Frame_pacing::Low_latency);
+}
+
+void Typing_test::draw_key_ex(Key key, sf::Vector2f pos, float width,
+                              const std::string &key_str, const int char_size) {
+  const sf::FloatRect rect{pos, sf::Vector2f{width, KEY_SIZE}};
+  key_rects[size_t(key)] = rect;
+  key_drawn_held[size_t(key)] = d.k_held(key);
+  if (!d.in_layer_region(rect)) return;
+  d.draw_rect(pos, sf::Vector2f{width, KEY_SIZE}, TopLeft,
+              (d.k_held(key) ? sf::Color{255, 255, 255, 100} : sf::Color{0, 0, 0, 0}));
+}
+
+void Typing_test::draw_key(Key key, sf::Vector2f pos,
+                           const std::string &key_str, const int char_size) {
+  draw_key_ex(key, pos, KEY_SIZE, key_str, char_size);
+}
+
+void Typing_test::draw_keys(Key key) {
+  switch (key) {
+  case Key::A:
+    draw_key(Key::A,
+	      {CAPS_SIZE + (KEY_SIZE * 0), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "A");
+    break;
+  case Key::B:
+    draw_key(Key::B, {SHIFT_SIZE + (KEY_SIZE * 4), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "B");
+    break;
+  case Key::C:
+    draw_key(Key::C, {SHIFT_SIZE + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "C");
+    break;
+  case Key::D:
+    draw_key(Key::D,
+	      {CAPS_SIZE + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "D");
+    break;
+  case Key::E:
+    draw_key(Key::E,
+	      {TAB_SIZE + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "E");
+    break;
+  case Key::F:
+    draw_key(Key::F,
+	      {CAPS_SIZE + (KEY_SIZE * 3), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "F");
+    break;
+  case Key::G:
+    draw_key(Key::G,
+	      {CAPS_SIZE + (KEY_SIZE * 4), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "G");
+    break;
+  case Key::H:
+    draw_key(Key::H,
+	      {CAPS_SIZE + (KEY_SIZE * 5), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "H");
+    break;
+  case Key::I:
+    draw_key(Key::I,
+	      {TAB_SIZE + (KEY_SIZE * 7), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "I");
+    break;
+  case Key::J:
+    draw_key(Key::J,
+	      {CAPS_SIZE + (KEY_SIZE * 6), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "J");
+    break;
+  case Key::K:
+    draw_key(Key::K,
+	      {CAPS_SIZE + (KEY_SIZE * 7), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "K");
+    break;
+  case Key::L:
+    draw_key(Key::L,
+	      {CAPS_SIZE + (KEY_SIZE * 8), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "L");
+    break;
+  case Key::M:
+    draw_key(Key::M, {SHIFT_SIZE + (KEY_SIZE * 6), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "M");
+    break;
+  case Key::N:
+    draw_key(Key::N, {SHIFT_SIZE + (KEY_SIZE * 5), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "N");
+    break;
+  case Key::O:
+    draw_key(Key::O,
+	      {TAB_SIZE + (KEY_SIZE * 8), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "O");
+    break;
+  case Key::P:
+    draw_key(Key::P,
+	      {TAB_SIZE + (KEY_SIZE * 9), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "P");
+    break;
+  case Key::Q:
+    draw_key(Key::Q,
+	      {TAB_SIZE + (KEY_SIZE * 0), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "Q");
+    break;
+  case Key::R:
+    draw_key(Key::R,
+	      {TAB_SIZE + (KEY_SIZE * 3), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "R");
+    break;
+  case Key::S:
+    draw_key(Key::S,
+	      {CAPS_SIZE + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "S");
+    break;
+  case Key::T:
+    draw_key(Key::T,
+	      {TAB_SIZE + (KEY_SIZE * 4), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "T");
+    break;
+  case Key::U:
+    draw_key(Key::U,
+	      {TAB_SIZE + (KEY_SIZE * 6), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "U");
+    break;
+  case Key::V:
+    draw_key(Key::V, {SHIFT_SIZE + (KEY_SIZE * 3), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "V");
+    break;
+  case Key::W:
+    draw_key(Key::W,
+	      {TAB_SIZE + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "W");
+    break;
+  case Key::X:
+    draw_key(Key::X, {SHIFT_SIZE + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "X");
+    break;
+  case Key::Y:
+    draw_key(Key::Y,
+	      {TAB_SIZE + (KEY_SIZE * 5), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "Y");
+    break;
+  case Key::Z:
+    draw_key(Key::Z, {SHIFT_SIZE + (KEY_SIZE * 0), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "Z");
+    break;
+  case Key::Num0:
+    draw_key(Key::Num0, {(KEY_SIZE * 10), KEY_SIZE + UPPER_PAD}, "0");
+    break;
+  case Key::Num1:
+    draw_key(Key::Num1, {(KEY_SIZE * 1), KEY_SIZE + UPPER_PAD}, "1");
+    break;
+  case Key::Num2:
+    draw_key(Key::Num2, {(KEY_SIZE * 2), KEY_SIZE + UPPER_PAD}, "2");
+    break;
+  case Key::Num3:
+    draw_key(Key::Num3, {(KEY_SIZE * 3), KEY_SIZE + UPPER_PAD}, "3");
+    break;
+  case Key::Num4:
+    draw_key(Key::Num4, {(KEY_SIZE * 4), KEY_SIZE + UPPER_PAD}, "4");
+    break;
+  case Key::Num5:
+    draw_key(Key::Num5, {(KEY_SIZE * 5), KEY_SIZE + UPPER_PAD}, "5");
+    break;
+  case Key::Num6:
+    draw_key(Key::Num6, {(KEY_SIZE * 6), KEY_SIZE + UPPER_PAD}, "6");
+    break;
+  case Key::Num7:
+    draw_key(Key::Num7, {(KEY_SIZE * 7), KEY_SIZE + UPPER_PAD}, "7");
+    break;
+  case Key::Num8:
+    draw_key(Key::Num8, {(KEY_SIZE * 8), KEY_SIZE + UPPER_PAD}, "8");
+    break;
+  case Key::Num9:
+    draw_key(Key::Num9, {(KEY_SIZE * 9), KEY_SIZE + UPPER_PAD}, "9");
+    break;
+  case Key::Escape:
+    draw_key(Key::Escape, {0.f, 0.f}, "Esc", 8);
+    break;
+  case Key::LControl:
+    draw_key_ex(Key::LControl, {0.f, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Ctrl", 8);
+    break;
+  case Key::LShift:
+    draw_key_ex(Key::LShift, {0.f, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)}, SHIFT_SIZE,
+		"Shift", 8);
+    break;
+  case Key::LAlt:
+    draw_key_ex(Key::LAlt,
+		{(BOTTOM_KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Alt", 8);
+    break;
+  case Key::LSystem:
+    draw_key_ex(Key::LSystem,
+		{(BOTTOM_KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Win", 8);
+    break;
+  case Key::RControl:
+    draw_key_ex(Key::RControl, {(BOTTOM_KEY_SIZE * 3) + SPACE_SIZE + (BOTTOM_KEY_SIZE * 3), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Ctrl", 8);
+    break;
+  case Key::RShift:
+    draw_key_ex(Key::RShift, {SHIFT_SIZE + (KEY_SIZE * 10), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)}, RSHIFT_SIZE, "Shift", 8);
+    break;
+  case Key::RAlt:
+    draw_key_ex(Key::RAlt,
+		{(BOTTOM_KEY_SIZE * 3) + SPACE_SIZE,
+		 KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Alt", 8);
+    break;
+  case Key::RSystem:
+    break;
+  case Key::Menu:
+    draw_key_ex(Key::Menu,
+		{(BOTTOM_KEY_SIZE * 5) + SPACE_SIZE,
+		 KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		BOTTOM_KEY_SIZE, "Menu", 8);
+    break;
+  case Key::LBracket:
+    draw_key(Key::LBracket,
+	      {TAB_SIZE + (KEY_SIZE * 10), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "[");
+    break;
+  case Key::RBracket:
+    draw_key(Key::RBracket,
+	      {TAB_SIZE + (KEY_SIZE * 11), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "]");
+    break;
+  case Key::Semicolon:
+    draw_key(Key::Semicolon,
+	      {CAPS_SIZE + (KEY_SIZE * 9), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      ";");
+    break;
+  case Key::Comma:
+    draw_key(Key::Comma,
+	      {SHIFT_SIZE + (KEY_SIZE * 7), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      ",");
+    break;
+  case Key::Period:
+    draw_key(Key::Period,
+	      {SHIFT_SIZE + (KEY_SIZE * 8), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      ".");
+    break;
+  case Key::Quote:
+    draw_key(Key::Quote,
+	      {CAPS_SIZE + (KEY_SIZE * 10), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "'");
+    break;
+  case Key::Slash:
+    draw_key(Key::Slash,
+	      {SHIFT_SIZE + (KEY_SIZE * 9), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "/");
+    break;
+  case Key::BackSlash:
+    draw_key_ex(Key::BackSlash,
+		{TAB_SIZE + (KEY_SIZE * 12), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+		BACKSLASH_SIZE, "\\");
+    break;
+  case Key::Tilde:
+    draw_key(Key::Tilde, {0.f, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 0)}, "`");
+    break;
+  case Key::Equal:
+    draw_key(Key::Equal, {(KEY_SIZE * 12), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 0)},
+	      "=");
+    break;
+  case Key::Hyphen:
+    draw_key(Key::Hyphen, {(KEY_SIZE * 11), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 0)},
+	      "-");
+    break;
+  case Key::Space:
+    draw_key_ex(Key::Space,
+		{(BOTTOM_KEY_SIZE * 3), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		SPACE_SIZE, " ");
+    break;
+  case Key::Enter:
+    draw_key_ex(Key::Enter,
+		{CAPS_SIZE + (KEY_SIZE * 11), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+		ENTER_SIZE, "Enter", 8);
+    break;
+  case Key::Backspace:
+    draw_key_ex(Key::Backspace,
+		{(KEY_SIZE * 13), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 0)},
+		BACKSPACE_SIZE, "Bckspc", 8);
+    break;
+  case Key::Tab:
+    draw_key_ex(Key::Tab, {0.f, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)}, TAB_SIZE,
+		"Tab", 8);
+    break;
+  case Key::PageUp:
+  case Key::PageDown:
+  case Key::End:
+  case Key::Home:
+  case Key::Insert:
+  case Key::Delete:
+  case Key::Add:
+  case Key::Subtract:
+  case Key::Multiply:
+  case Key::Divide:
+    break;
+  case Key::Left:
+    draw_key(Key::Left,
+	      {NUM_X - UPPER_PAD - (KEY_SIZE * 3),
+	       KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+	      "<-", 8);
+    break;
+  case Key::Right:
+    draw_key(Key::Right,
+	      {NUM_X - UPPER_PAD - (KEY_SIZE * 1),
+	       KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+	      "->", 8);
+    break;
+  case Key::Up:
+    draw_key(Key::Up,
+	      {NUM_X - UPPER_PAD - (KEY_SIZE * 2),
+	       KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "^", 8);
+    break;
+  case Key::Down:
+    draw_key(Key::Down,
+	      {NUM_X - UPPER_PAD - (KEY_SIZE * 2),
+	       KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+	      "v", 8);
+    break;
+  case Key::KeyCount:
+    draw_key_ex(Key::KeyCount, {0.f, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)}, CAPS_SIZE,
+		"Caps", 8);
+    break;
+
+  case Key::Numpad0:
+    draw_key_ex(Key::Numpad0, {NUM_X, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 4)},
+		KEY_SIZE * 2, "0");
+    break;
+  case Key::Numpad1:
+    draw_key(Key::Numpad1, {NUM_X, KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)}, "1");
+    break;
+  case Key::Numpad2:
+    draw_key(Key::Numpad2,
+	      {NUM_X + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "2");
+    break;
+  case Key::Numpad3:
+    draw_key(Key::Numpad3,
+	      {NUM_X + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 3)},
+	      "3");
+    break;
+  case Key::Numpad4:
+    draw_key(Key::Numpad4,
+	      {NUM_X + (KEY_SIZE * 0), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "4");
+    break;
+  case Key::Numpad5:
+    draw_key(Key::Numpad5,
+	      {NUM_X + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "5");
+    break;
+  case Key::Numpad6:
+    draw_key(Key::Numpad6,
+	      {NUM_X + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 2)},
+	      "6");
+    break;
+  case Key::Numpad7:
+    draw_key(Key::Numpad7,
+	      {NUM_X + (KEY_SIZE * 0), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "7");
+    break;
+  case Key::Numpad8:
+    draw_key(Key::Numpad8,
+	      {NUM_X + (KEY_SIZE * 1), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "8");
+    break;
+  case Key::Numpad9:
+    draw_key(Key::Numpad9,
+	      {NUM_X + (KEY_SIZE * 2), KEY_SIZE + UPPER_PAD + (KEY_SIZE * 1)},
+	      "9");
+    break;
+
+  default: {
+    // UNREACHABLE();
+  } break;
+  }
+}
+
+void Typing_test::draw_keyboard() {
+  d.camera_view();
+  sf::Vector2f padding{10.f, 35.f};
+  d.camera_follow({(d.width/2.f) - padding.x, -padding.y});
+  keyboard_view = d._camera_view;
+  for (size_t i=0; i < int(Key::KeyCount); ++i) {
+    draw_keys(Key(i));
+  }
+  d.default_view();
+}
+
+void Typing_test::draw_passage() {
+  std::string glyph(1, ' ');
+  for (size_t i = 0; i < text.size(); ++i) {
+    char ch = text[i];
+
+    if (cells[i].width == 0.f || !d.in_layer_region(cells[i])) continue;
+
+    sf::Color col = sf::Color::White;
+    if (i > buffer.size()-1 || buffer.empty()){
+      col.a = 100;
+    }
+
+    if (!buffer.empty() && i < buffer.size()){
+      if (ch != buffer[i]) col = sf::Color::Red;
+    }
+
+    glyph[0] = ch;
+    d.draw_text(cells[i].getPosition(), glyph, TopLeft, DEFAULT_CHAR_SIZE, col);
+  }
+}
+
+void Typing_test::frame() {
+  // the HUD shows hundredths of a second, which stop changing once done
+  const float clock_step = 0.01f;
+  d.wait_for_frame(done ? -1.f
+                        : clock_step - std::fmod(time_passed, clock_step));
+  d.pace_frame();
+
+  // calculate delta time
+  float delta = d.calc_delta();
+
+  // update window title
+  d.update_title();
+
+  // event loop
+  sf::Event e;
+  d.update_mouse();
+  d.update_key();
+  {
+    PROFILE_SCOPE("event poll");
+    while (d.poll_event(e)) {
+      d.handle_close(e);
+      d.update_mouse_event(e);
+      d.update_key_event(e);
+      d.handle_text(e, buffer);
+    }
+  }
+  for (size_t i = 0; i < size_t(Key::KeyCount); ++i) {
+    if (key_rects[i].width > 0.f && d.k_held(Key(i)) != key_drawn_held[i])
+      d.invalidate(keyboard_layer, key_rects[i], keyboard_view);
+  }
+  if (buffer.size() > text.size()) buffer.pop_back();
+
+  // clear
+  d.clear();
+
+  // update
+  {
+    PROFILE_SCOPE("update");
+    if (!done) time_passed += delta;
+
+    if (buffer == text && !done){
+      time_done = time_passed;
+      done = true;
+
+      const Latency_histogram &lat = d.input_latency;
+      print("Done in {:.2f}s ({:.2f} ch/s)\n", time_done,
+            float(buffer.size()) / time_done);
+      print("Input latency over {} keystrokes: p50 {:.2f}ms, p95 {:.2f}ms, "
+            "p99 {:.2f}ms, max {:.2f}ms\n",
+            lat.count, lat.percentile(0.5f), lat.percentile(0.95f),
+            lat.percentile(0.99f), lat.max_ms);
+    }
+
+    character_per_sec = float(buffer.size()) / time_passed;
+  }
+
+  // draw
+  while (d.begin_layer(keyboard_layer)) {
+    PROFILE_SCOPE("draw_keyboard");
+    draw_keyboard();
+    d.end_layer();
+  }
+  d.draw_layer(keyboard_layer);
+
+  format_into(time_str, "time: {:.2f}s", time_passed);
+  format_into(cps_str, "ch/s: {:.2f}", character_per_sec);
+  format_into(lat_str, "lat: {:.1f}/{:.1f}/{:.1f}ms",
+              d.input_latency.percentile(0.5f),
+              d.input_latency.percentile(0.95f),
+              d.input_latency.percentile(0.99f));
+  {
+    PROFILE_SCOPE("UI");
+    ui.begin({d.width-200.f, 10.f});
+
+    ui.text(time_str, TopLeft);
+    ui.text(cps_str, TopLeft);
+    ui.text(lat_str, TopLeft, DEFAULT_CHAR_SIZE / 2);
+
+    // only the part of the HUD layer the panel covers is redrawn, and only
+    // when it changed
+    if (ui.end(false)) d.invalidate(hud_layer, ui.changed_bounds());
+    while (d.begin_layer(hud_layer)) {
+      ui.draw();
+      d.end_layer();
+    }
+  }
+  d.draw_layer(hud_layer);
+
+  if (buffer != drawn_buffer) {
+    // only the characters from the first change on look different
+    size_t first = 0;
+    while (first < buffer.size() && first < drawn_buffer.size() &&
+           buffer[first] == drawn_buffer[first])
+      first++;
+    const size_t last = std::min(std::max(buffer.size(), drawn_buffer.size()), text.size());
+    for (size_t i = first; i < last; ++i) {
+      if (cells[i].width > 0.f) d.invalidate(passage_layer, cells[i]);
+    }
+    drawn_buffer = buffer;
+  }
+  while (d.begin_layer(passage_layer)) {
+    PROFILE_SCOPE("passage draw");
+    draw_passage();
+    d.end_layer();
+  }
+  d.draw_layer(passage_layer);
+
+  // F3: render stats overlay, F4: record them to render_stats.csv
+  if (d.k_pressed(Key::F3)) show_render_stats = !show_render_stats;
+  if (d.k_pressed(Key::F4))
+    d.record_render_stats(d.stats_csv.is_open() ? "" : "render_stats.csv");
+  if (show_render_stats)
+    d.draw_render_stats({d.width - 200.f, 120.f});
+
+#ifdef SH_PROFILER
+  d.draw_frame_graph({10.f, float(d.height) - 70.f}, {240.f, 60.f});
+  if (d.k_pressed(Key::F2)) Profiler::export_chrome_trace("trace.json");
+#endif
+
+  // display
+  d.display();
+}
+
+#endif // _TYPING_TEST_H_
@@ -0,0 +1,58 @@
+#define SFML_HELPER_IMPLEMENTATION
+#include <sfml-helper.hpp>
+
+using namespace sh;
+
+#include "../src/typing_test.hpp"
+
+#ifndef SH_TRACK_ALLOCATIONS
+#error "alloc_check needs SH_TRACK_ALLOCATIONS"
+#endif
+
+// Runs wpm's own frame (Typing_test::frame(), the loop body of main()) in a
+// hidden window, without input, and fails if a frame after warm-up allocates
+// on the main thread. The HUD clock keeps ticking, so the title, the HUD
+// layer and its text are redrawn along the way. Needs data.dat (with the
+// default font) in the working directory.
+int main() {
+  const size_t WARMUP_FRAMES = 60;
+  const size_t CHECKED_FRAMES = 300;
+
+  Data d;
+  if (!d.init(1280, 720, 1, "wpm-alloc-check"))
+    return 1;
+  d.win.setVisible(false);
+
+  Typing_test test(d, "The quick brown fox jumps over the lazy dog.\n"
+                      "Pack my box with five dozen liquor jugs.");
+  size_t failed_frames = 0, skipped_frames = 0;
+
+  for (size_t frame = 0; frame < WARMUP_FRAMES + CHECKED_FRAMES; ++frame) {
+    Alloc_scope scope;
+    test.frame();
+    if (frame < WARMUP_FRAMES || scope.allocations() == 0)
+      continue;
+
+#ifndef _WIN32
+    // outside Windows the title goes through sf::Window::setTitle(), which
+    // builds an sf::String, so title refreshes are exempt there
+    if (d.title_updated) {
+      skipped_frames++;
+      continue;
+    }
+#endif
+    print("frame {}: {} allocations ({} bytes)\n", frame, scope.allocations(),
+          scope.bytes());
+    failed_frames++;
+  }
+
+  if (failed_frames > 0) {
+    print("FAIL: {} of {} frames allocated\n", failed_frames, CHECKED_FRAMES);
+    logger::flush();
+    return 1;
+  }
+  print("OK: {} frames without allocations ({} title refreshes exempt)\n",
+        CHECKED_FRAMES - skipped_frames, skipped_frames);
+  logger::flush();
+  return 0;
+}
@@ -0,0 +1,59 @@
+#define SFML_HELPER_IMPLEMENTATION
+#include <sfml-helper.hpp>
+
+using namespace sh;
+
+void usage(const std::string &program) {
+  print("Usage: {} [-o <output>] <dir|manifest>...\n", program);
+  print("       {} --verify [<file>]\n", program);
+  print("  Packs every asset found in <dir> (type inferred from the extension)\n");
+  print("  or listed in <manifest> into a single data file.\n");
+  print("  -o <output>  output file (default: data.dat)\n");
+  print("  --verify     check every chunk's checksum (default: data.dat)\n");
+}
+
+int main(int argc, char *argv[]) {
+  ARG();
+  std::string program = arg.pop_arg();
+  std::string output = "data.dat";
+  std::vector<std::string> inputs;
+
+  while (arg) {
+    std::string a = arg.pop_arg();
+    if (a == "-h" || a == "--help") {
+      usage(program);
+      return 0;
+    } else if (a == "--verify") {
+      std::string file = arg ? arg.pop_arg() : "data.dat";
+      return verify_data(file) ? 0 : 1;
+    } else if (a == "-o") {
+      if (!arg) {
+        usage(program);
+        ERR("Expected output filename after `-o`\n");
+      }
+      output = arg.pop_arg();
+    } else {
+      inputs.push_back(a);
+    }
+  }
+
+  if (inputs.empty()) {
+    usage(program);
+    ERR("No input directory or manifest given\n");
+  }
+
+  std::vector<Pack_entry> entries;
+  for (auto &input : inputs) {
+    bool ok = fs::is_directory(input)
+                  ? pack_entries_from_dir(entries, input)
+                  : pack_entries_from_manifest(entries, input);
+    if (!ok)
+      return 1;
+  }
+
+  if (entries.empty()) {
+    ERR("No assets found in input(s)\n");
+  }
+
+  return write_pack(entries, output) ? 0 : 1;
+}